@@ -189,9 +189,14 @@
 #define GF_TILEPERSP2	26	// tiles with perspective, double pixels (parameters as GF_TILEPERSP)
 #define GF_TILEPERSP3	27	// tiles with perspective, triple pixels (parameters as GF_TILEPERSP)
 #define GF_TILEPERSP4	28	// tiles with perspective, quadruple pixels (parameters as GF_TILEPERSP)
+#define GF_XTEXT	29	// 8-pixel color text with attributes, character + background color + foreground color
+				//	+ attribute byte in a separate plane (B0 bold, B1 dim, B2 underline, B3 blink)
+				//      (num = number of characters, font is 8-bit width,
+				//	par = pointer to 1-bit font followed by bold font, par2 LOW = offset of attributes
+				//	from data, par2 HIGH = pitch of attribute rows, par3 = font height)
 
 #define GF_GRP3MIN	GF_GRAPH4	// 3rd group minimal format
-#define GF_GRP3MAX	GF_TILEPERSP4	// 3rd group maximal format
+#define GF_GRP3MAX	GF_XTEXT	// 3rd group maximal format
 
 
 #define FRACT		12	// number of bits of fractional part of fractint number (use max. 13, min. 8)
@@ -19,6 +19,13 @@ volatile u32 Frame;		// frame counter
 volatile int BufInx;		// current buffer set (0..1)
 volatile Bool VSync;		// current scan line is vsync or dark
 
+// scan-out headroom statistics (SysTick of core 1, in system clock cycles)
+volatile u32 VgaStatSeq;	// sequence counter, odd while VgaStat is being updated
+sVgaStat VgaStat;		// statistics of last frame
+sVgaStat VgaStatCur;		// statistics of current frame
+u32 VgaStatSum;			// sum of VgaLine() times in current frame
+u32 VgaStatStep;		// histogram bucket width
+
 // line buffers
 ALIGNED u8	LineBuf1[DBUF_MAX]; // scanline 1 image data
 ALIGNED u8	LineBuf2[DBUF_MAX]; // scanline 2 image data
@@ -46,8 +53,15 @@ int	CtrlBufSize[LAYERS_MAX] = { CBUF0_MAX, CBUF1_MAX, CBUF2_MAX, CBUF3_MAX }; //
 // next control buffer
 u32*	CtrlBufNext[LAYERS_MAX];
 
+// hot render data, placed in the scratch X bank (4 KB, it also holds the 2 KB stack of core 1)
+#if RENDER_SCRATCH
+#define RENDER_DATA __scratch_x("render")
+#else
+#define RENDER_DATA
+#endif
+
 // render font pixel mask
-u32 RenderTextMask[512];
+u32 RENDER_DATA RenderTextMask[512];
 
 // saved integer divider state
 hw_divider_state_t DividerState;
@@ -147,7 +161,12 @@ int __not_in_flash_func(VgaBufProcess)()
 			do {
 				u8 a = *(volatile u8*)&VGA_PIO->sm[sm].addr & 0x1f;
 				if (a <= CurLayerProg.maxidle+LAYER_OFFSET) break;
-			} while ((u32)(time_us_32() - t1) < (u32)10); // wait max. 10 us, low resolution can take long time
+				if ((u32)(time_us_32() - t1) >= (u32)10) // wait max. 10 us, low resolution can take long time
+				{
+					VgaStatCur.timeout++;
+					break;
+				}
+			} while (True);
 
 			// stop DMA channel
 			dma_channel_abort(VGA_DMA_PIO(layer));
@@ -370,9 +389,68 @@ u32* __not_in_flash_func(VgaBufRender)(u32* cbuf, u32* cbuf0, u8* dbuf, int y0)
 	return cbuf;
 }
 
+// start collecting headroom statistics of new frame
+static void __not_in_flash_func(VgaStatStart)()
+{
+	VgaStatCur.frame = Frame;
+	VgaStatCur.lines = 0;
+	VgaStatCur.min = 0xffffffff;
+	VgaStatCur.max = 0;
+	VgaStatSum = 0;
+	memset(VgaStatCur.hist, 0, sizeof(VgaStatCur.hist));
+}
+
+// account time spent in VgaLine() (integer divider state must be saved)
+static void __not_in_flash_func(VgaStatLine)(u32 t, int line)
+{
+	// frame completed, publish its statistics
+	if ((line == 1) && (VgaStatCur.lines > 0))
+	{
+		VgaStatCur.avg = VgaStatSum / VgaStatCur.lines;
+		VgaStatSeq++;
+		__dmb();
+		memcpy(&VgaStat, &VgaStatCur, sizeof(sVgaStat));
+		__dmb();
+		VgaStatSeq++;
+		VgaStatStart();
+	}
+
+	// next scanline IRQ already pending - DMA may be sending incomplete buffer
+	if (dma_channel_get_irq0_status(VGA_DMA_PIO0)) VgaStatCur.miss++;
+
+	VgaStatCur.lines++;
+	VgaStatSum += t;
+	if (t < VgaStatCur.min) VgaStatCur.min = t;
+	if (t > VgaStatCur.max) VgaStatCur.max = t;
+
+	int b = 0;
+	u32 lim = VgaStatStep;
+	while ((t >= lim) && (b < VGASTAT_HIST-1))
+	{
+		b++;
+		lim += VgaStatStep;
+	}
+	VgaStatCur.hist[b]++;
+}
+
+// get headroom statistics of last frame (lock-free, can be called from other core)
+void VgaStatGet(sVgaStat* stat)
+{
+	u32 seq;
+	do {
+		seq = VgaStatSeq;
+		__dmb();
+		memcpy(stat, (const void*)&VgaStat, sizeof(sVgaStat));
+		__dmb();
+	} while ((seq & 1) || (seq != VgaStatSeq));
+}
+
 // VGA DMA handler - called on end of every scanline
 extern "C" void __not_in_flash_func(VgaLine)()
 {
+	// start time
+	u32 start = systick_hw->cvr;
+
 	// process scanline buffers (will save integer divider state into DividerState)
 	int bufinx = VgaBufProcess();
 
@@ -469,6 +547,10 @@ extern "C" void __not_in_flash_func(VgaLine)()
 	*cbuf++ = 0; // end mark
 	*cbuf++ = 0; // end mark
 
+	// measure time spent (SysTick counts down)
+	u32 t = (start - systick_hw->cvr) & 0xffffff;
+	VgaStatLine(t, line);
+
 	// restore integer divider state
 	hw_divider_restore_state(&DividerState);
 }
@@ -914,6 +996,15 @@ void VgaInit(const sVmode* vmode)
 	// initialize scanline type table
 	ScanlineTypeInit(vmode);
 
+	// start SysTick of this core, free running on system clock, used to measure headroom
+	systick_hw->rvr = 0xffffff;
+	systick_hw->csr = 5;
+	VgaStatCur.budget = vmode->htot * vmode->div;
+	VgaStatStep = VgaStatCur.budget / VGASTAT_HIST;
+	VgaStatCur.miss = 0;
+	VgaStatCur.timeout = 0;
+	VgaStatStart();
+
 	// prepare render font pixel mask
 	for (i = 0; i < 256; i++)
 	{
@@ -31,6 +31,22 @@ extern volatile u32 Frame;	// frame counter
 extern volatile int BufInx;	// current buffer set (0..1)
 extern volatile Bool VSync;	// current scan line is vsync or dark
 
+// scan-out headroom statistics of one frame (in system clock cycles, measured by SysTick of core 1)
+#define VGASTAT_HIST	8	// number of histogram buckets (of 1/8 of scanline time each)
+typedef struct {
+	u32	frame;		// frame number
+	u32	lines;		// number of scanlines measured (all scanlines, including sync)
+	u32	budget;		// scanline time
+	u32	min;		// shortest VgaLine()
+	u32	max;		// longest VgaLine()
+	u32	avg;		// average VgaLine()
+	u16	hist[VGASTAT_HIST]; // number of scanlines by time spent (last bucket: 7/8 or more)
+	u32	miss;		// total deadline misses since videomode init (next scanline already started)
+	u32	timeout;	// total layer restart timeouts in VgaBufProcess() since videomode init
+} sVgaStat;
+
+extern volatile u32 VgaStatSeq;	// sequence counter, odd while statistics are being updated
+
 // line buffers
 extern ALIGNED u8	LineBuf1[DBUF_MAX]; // scanline 1 image data
 extern ALIGNED u8	LineBuf2[DBUF_MAX]; // scanline 2 image data
@@ -120,6 +136,9 @@ void VgaCore();
 // request to initialize VGA videomode, NULL=only stop driver (wait to initialization completes)
 void VgaInitReq(const sVmode* vmode);
 
+// get headroom statistics of last frame (lock-free, can be called from other core)
+void VgaStatGet(sVgaStat* stat);
+
 // execute core 1 remote function
 void Core1Exec(void (*fnc)());
 
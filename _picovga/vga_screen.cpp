@@ -11,6 +11,26 @@
 sScreen Screen = { .num = 0 };	// default video screen
 sScreen* pScreen = &Screen;	// pointer to current video screen
 
+// palette of the GF_XTEXT format (R3G3B2 color expanded to 32 bits)
+ALIGNED u32 XTextPal[256];
+
+// palette of the GF_XTEXT format for dim characters (half intensity)
+ALIGNED u32 XTextPalDim[256];
+
+// attribute tables of the GF_XTEXT format
+ALIGNED u32 XTextAttr[4][32][2];
+
+// attributes of a GF_XTEXT row without attribute plane
+ALIGNED u8 XTextNoAttr[MAXX/8+4];
+
+// set color of the GF_XTEXT palette (and its half intensity version)
+void XTextPalSet(u8 inx, u8 col)
+{
+	u32 c = col * 0x01010101;
+	XTextPal[inx] = c;
+	XTextPalDim[inx] = (c >> 1) & 0x6D6D6D6D; // components shifted right, bits of the next component cleared
+}
+
 // clear screen (set 0 strips, does not modify sprites)
 void ScreenClear(sScreen* s)
 {
@@ -286,6 +306,49 @@ void ScreenSegmCText(sSegm* segm, const void* data, const void* font, u16 fonthe
 	__dmb();
 }
 
+// set video segment to 8-pixel color text with attributes
+//   data = pointer to text buffer (character + background color + foreground color),
+//          colors are indexes to XTextPal
+//   font = pointer to 1-bit font of 256 characters of width 8, followed by the bold version
+//   fontheight = font height
+//   wb = pitch - number of bytes between text lines
+//   attroff = offset of attributes from data (attribute byte per character, max. 65535),
+//             0 = no attributes (faster rendering)
+//   attrwb = pitch of attribute rows
+void ScreenSegmXText(sSegm* segm, const void* data, const void* font, u16 fontheight, int wb,
+	u16 attroff, u16 attrwb)
+{
+	segm->form = GF_COLOR;
+	__dmb();
+
+	// attribute tables: bold from the bold plane, underline sets all pixels
+	// in the last scanline, hidden blink clears them, selected inverts them,
+	// dim takes the foreground from the half intensity palette
+	for (int t = 0; t < 4; t++)
+	{
+		for (int a = 0; a < 32; a++)
+		{
+			u32 andmask = 0xff;
+			u32 xormask = 0;
+			if ((t & 1) && (a & B2)) { andmask = 0; xormask = 0xff; }
+			if ((t & 2) && (a & B3)) { andmask = 0; xormask = 0; }
+			if (a & B4) xormask ^= 0xff;
+			u32 plane = (a & B0) ? (u32)fontheight*256 : 0;
+			XTextAttr[t][a][0] = andmask | (xormask << 8) | (plane << 16);
+			XTextAttr[t][a][1] = (a & B1) ? (u32)XTextPalDim : (u32)XTextPal;
+		}
+	}
+
+	segm->data = data;
+	segm->par = (u32)font;
+	segm->par2 = attroff | ((u32)attrwb << 16);
+	segm->par3 = fontheight;
+	segm->wb = wb;
+	__dmb();
+	segm->form = GF_XTEXT;
+	__dmb();
+}
+
 // set video segment to 8-pixel gradient color text
 //   data = pointer to text buffer (character + foreground color)
 //   font = pointer to 1-bit font of 256 characters of width 8 (total width of image 2048 pixels)
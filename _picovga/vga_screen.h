@@ -43,6 +43,24 @@ typedef struct {
 extern sScreen Screen;		// default video screen
 extern sScreen* pScreen;	// pointer to current video screen
 
+// palette of the GF_XTEXT format (R3G3B2 color expanded to 32 bits, color*0x01010101)
+// and the half intensity colors for dim characters (set both with XTextPalSet)
+extern u32 XTextPal[256];
+extern u32 XTextPalDim[256];
+
+// attribute tables of the GF_XTEXT format, for each attribute value:
+//   [0] B0..B7 AND mask of the font sample, B8..B15 XOR mask, B16..B31 offset of the font plane
+//   [1] palette of the foreground color (XTextPal or XTextPalDim)
+// [0] other scanlines, [1] last scanline of the font (underline),
+// [2] and [3] the same while blinking characters are hidden
+extern u32 XTextAttr[4][32][2];
+
+// attributes of a GF_XTEXT row without attribute plane (all 0)
+extern u8 XTextNoAttr[MAXX/8+4];
+
+// set color of the GF_XTEXT palette
+void XTextPalSet(u8 inx, u8 col);
+
 // clear screen (set 0 strips, does not modify sprites)
 void ScreenClear(sScreen* s);
 
@@ -139,6 +157,19 @@ void ScreenSegmFText(sSegm* segm, const void* data, const void* font, u16 fonthe
 //   wb = pitch - number of bytes between text lines
 void ScreenSegmCText(sSegm* segm, const void* data, const void* font, u16 fontheight, int wb);
 
+// set video segment to 8-pixel color text with attributes
+//   data = pointer to text buffer (character + background color + foreground color),
+//          colors are indexes to XTextPal
+//   font = pointer to 1-bit font of 256 characters of width 8, followed by the bold version
+//   fontheight = font height
+//   wb = pitch - number of bytes between text lines
+//   attroff = offset of attributes from data (attribute byte per character, max. 65535),
+//             0 = no attributes (faster rendering)
+//   attrwb = pitch of attribute rows
+// The attribute tables are set up for the font height (the same for all GF_XTEXT segments)
+void ScreenSegmXText(sSegm* segm, const void* data, const void* font, u16 fontheight, int wb,
+	u16 attroff, u16 attrwb);
+
 // set video segment to 8-pixel gradient color text
 //   data = pointer to text buffer (character + foreground color)
 //   font = pointer to 1-bit font of 256 characters of width 8 (total width of image 2048 pixels)
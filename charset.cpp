@@ -0,0 +1,204 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Character sets and glyph mapping
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "include.h"
+
+// Unicode code points with a glyph in the font (FontBold8x16), sorted by code point
+// The font has ASCII in 0x20-0x7E, box drawing in 0x10-0x1F (bits 0 to 3 are
+// lines to the left, up, right and down), quadrant blocks in 0x80-0x8F
+// (bits 0 to 3 are upper right, upper left, lower right and lower left),
+// some symbols in 0x01-0x0F and inverted copies in 0x90-0xFF
+// Characters that are not in the font are mapped to similar ones
+struct glyph_map {
+    u16 code;
+    u8 glyph;
+};
+
+static constexpr glyph_map glyph_table[] = {
+    // Latin-1, accents are dropped
+    {0x00A0,0x20}, {0x00A1,0x21}, {0x00A2,0x63}, {0x00A3,0x4C}, {0x00A5,0x59}, {0x00A6,0x7C}, {0x00A8,0x22}, {0x00A9,0x43},
+    {0x00AA,0x61}, {0x00AB,0x3C}, {0x00AD,0x2D}, {0x00AE,0x52}, {0x00B0,0x6F}, {0x00B1,0x2B}, {0x00B2,0x32}, {0x00B3,0x33},
+    {0x00B4,0x27}, {0x00B5,0x75}, {0x00B7,0x10}, {0x00B9,0x31}, {0x00BA,0x6F}, {0x00BB,0x3E}, {0x00BF,0x3F}, {0x00C0,0x41},
+    {0x00C1,0x41}, {0x00C2,0x41}, {0x00C3,0x41}, {0x00C4,0x41}, {0x00C5,0x41}, {0x00C6,0x41}, {0x00C7,0x43}, {0x00C8,0x45},
+    {0x00C9,0x45}, {0x00CA,0x45}, {0x00CB,0x45}, {0x00CC,0x49}, {0x00CD,0x49}, {0x00CE,0x49}, {0x00CF,0x49}, {0x00D1,0x4E},
+    {0x00D2,0x4F}, {0x00D3,0x4F}, {0x00D4,0x4F}, {0x00D5,0x4F}, {0x00D6,0x4F}, {0x00D7,0x78}, {0x00D8,0x4F}, {0x00D9,0x55},
+    {0x00DA,0x55}, {0x00DB,0x55}, {0x00DC,0x55}, {0x00DD,0x59}, {0x00DF,0x42}, {0x00E0,0x61}, {0x00E1,0x61}, {0x00E2,0x61},
+    {0x00E3,0x61}, {0x00E4,0x61}, {0x00E5,0x61}, {0x00E6,0x61}, {0x00E7,0x63}, {0x00E8,0x65}, {0x00E9,0x65}, {0x00EA,0x65},
+    {0x00EB,0x65}, {0x00EC,0x69}, {0x00ED,0x69}, {0x00EE,0x69}, {0x00EF,0x69}, {0x00F1,0x6E}, {0x00F2,0x6F}, {0x00F3,0x6F},
+    {0x00F4,0x6F}, {0x00F5,0x6F}, {0x00F6,0x6F}, {0x00F7,0x2F}, {0x00F8,0x6F}, {0x00F9,0x75}, {0x00FA,0x75}, {0x00FB,0x75},
+    {0x00FC,0x75}, {0x00FD,0x79}, {0x00FF,0x79},
+    // other letters
+    {0x0133,0x79}, {0x0192,0x66}, {0x03C0,0x6E},
+    // punctuation, arrows, math and scan lines
+    {0x2010,0x2D}, {0x2011,0x2D}, {0x2012,0x2D}, {0x2013,0x2D}, {0x2014,0x2D}, {0x2015,0x2D}, {0x2018,0x27}, {0x2019,0x27},
+    {0x201A,0x2C}, {0x201C,0x22}, {0x201D,0x22}, {0x2022,0x10}, {0x2026,0x2E}, {0x2032,0x27}, {0x2033,0x22}, {0x2039,0x3C},
+    {0x203A,0x3E}, {0x20AC,0x45}, {0x2122,0x54}, {0x2190,0x3C}, {0x2191,0x5E}, {0x2192,0x3E}, {0x2193,0x76}, {0x2194,0x2D},
+    {0x2195,0x7C}, {0x21D0,0x3C}, {0x21D2,0x3E}, {0x2212,0x2D}, {0x2219,0x10}, {0x2260,0x23}, {0x2264,0x3C}, {0x2265,0x3E},
+    {0x23BA,0x15}, {0x23BB,0x15}, {0x23BC,0x15}, {0x23BD,0x15},
+    // box drawing, light, heavy and double lines use the same glyphs
+    {0x2500,0x15}, {0x2501,0x15}, {0x2502,0x1A}, {0x2503,0x1A}, {0x2504,0x15}, {0x2505,0x15}, {0x2506,0x1A}, {0x2507,0x1A},
+    {0x2508,0x15}, {0x2509,0x15}, {0x250A,0x1A}, {0x250B,0x1A}, {0x250C,0x1C}, {0x250D,0x1C}, {0x250E,0x1C}, {0x250F,0x1C},
+    {0x2510,0x19}, {0x2511,0x19}, {0x2512,0x19}, {0x2513,0x19}, {0x2514,0x16}, {0x2515,0x16}, {0x2516,0x16}, {0x2517,0x16},
+    {0x2518,0x13}, {0x2519,0x13}, {0x251A,0x13}, {0x251B,0x13}, {0x251C,0x1E}, {0x251D,0x1E}, {0x251E,0x1E}, {0x251F,0x1E},
+    {0x2520,0x1E}, {0x2521,0x1E}, {0x2522,0x1E}, {0x2523,0x1E}, {0x2524,0x1B}, {0x2525,0x1B}, {0x2526,0x1B}, {0x2527,0x1B},
+    {0x2528,0x1B}, {0x2529,0x1B}, {0x252A,0x1B}, {0x252B,0x1B}, {0x252C,0x1D}, {0x252D,0x1D}, {0x252E,0x1D}, {0x252F,0x1D},
+    {0x2530,0x1D}, {0x2531,0x1D}, {0x2532,0x1D}, {0x2533,0x1D}, {0x2534,0x17}, {0x2535,0x17}, {0x2536,0x17}, {0x2537,0x17},
+    {0x2538,0x17}, {0x2539,0x17}, {0x253A,0x17}, {0x253B,0x17}, {0x253C,0x1F}, {0x253D,0x1F}, {0x253E,0x1F}, {0x253F,0x1F},
+    {0x2540,0x1F}, {0x2541,0x1F}, {0x2542,0x1F}, {0x2543,0x1F}, {0x2544,0x1F}, {0x2545,0x1F}, {0x2546,0x1F}, {0x2547,0x1F},
+    {0x2548,0x1F}, {0x2549,0x1F}, {0x254A,0x1F}, {0x254B,0x1F}, {0x254C,0x15}, {0x254D,0x15}, {0x254E,0x1A}, {0x254F,0x1A},
+    {0x2550,0x15}, {0x2551,0x1A}, {0x2552,0x1C}, {0x2553,0x1C}, {0x2554,0x1C}, {0x2555,0x19}, {0x2556,0x19}, {0x2557,0x19},
+    {0x2558,0x16}, {0x2559,0x16}, {0x255A,0x16}, {0x255B,0x13}, {0x255C,0x13}, {0x255D,0x13}, {0x255E,0x1E}, {0x255F,0x1E},
+    {0x2560,0x1E}, {0x2561,0x1B}, {0x2562,0x1B}, {0x2563,0x1B}, {0x2564,0x1D}, {0x2565,0x1D}, {0x2566,0x1D}, {0x2567,0x17},
+    {0x2568,0x17}, {0x2569,0x17}, {0x256A,0x1F}, {0x256B,0x1F}, {0x256C,0x1F}, {0x256D,0x1C}, {0x256E,0x19}, {0x256F,0x13},
+    {0x2570,0x16}, {0x2571,0x2F}, {0x2572,0x5C}, {0x2573,0x58}, {0x2574,0x11}, {0x2575,0x12}, {0x2576,0x14}, {0x2577,0x18},
+    {0x2578,0x11}, {0x2579,0x12}, {0x257A,0x14}, {0x257B,0x18}, {0x257C,0x15}, {0x257D,0x1A}, {0x257E,0x15}, {0x257F,0x1A},
+    // block elements
+    {0x2580,0x83}, {0x2581,0x8C}, {0x2582,0x8C}, {0x2583,0x8C}, {0x2584,0x8C}, {0x2585,0x8C}, {0x2586,0x8C}, {0x2587,0x8C},
+    {0x2588,0x8F}, {0x2589,0x8A}, {0x258A,0x8A}, {0x258B,0x8A}, {0x258C,0x8A}, {0x258D,0x8A}, {0x258E,0x8A}, {0x258F,0x8A},
+    {0x2590,0x85}, {0x2591,0x01}, {0x2592,0x01}, {0x2593,0x01}, {0x2594,0x83}, {0x2595,0x85}, {0x2596,0x88}, {0x2597,0x84},
+    {0x2598,0x82}, {0x2599,0x8E}, {0x259A,0x86}, {0x259B,0x8B}, {0x259C,0x87}, {0x259D,0x81}, {0x259E,0x89}, {0x259F,0x8D},
+    // geometric shapes and symbols
+    {0x25A0,0x8F}, {0x25AC,0x8C}, {0x25B2,0x5E}, {0x25BA,0x3E}, {0x25BC,0x76}, {0x25C4,0x3C}, {0x25C6,0x05}, {0x25CB,0x02},
+    {0x25CF,0x10}, {0x25D9,0x03}, {0x263A,0x08}, {0x263B,0x09}, {0x263C,0x0C}, {0x2660,0x07}, {0x2663,0x06}, {0x2665,0x04},
+    {0x2666,0x05}, {0x266A,0x0A}, {0x266B,0x0A}, {0xFFFD,0xBF},
+};
+
+#define GLYPH_TABLE_SIZE    (sizeof(glyph_table)/sizeof(glyph_table[0]))
+
+// Glyph in the font for a Unicode code point (binary search)
+static constexpr u8 glyph_lookup(u32 cp) {
+    int lo = 0;
+    int hi = GLYPH_TABLE_SIZE-1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        u32 code = glyph_table[mid].code;
+        if (cp == code) {
+            return glyph_table[mid].glyph;
+        } else if (cp < code) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return GLYPH_REPLACEMENT;
+}
+
+u8 charset_glyph(u32 cp) {
+    return glyph_lookup(cp);
+}
+
+// Code points of the glyphs in 0x00-0x1F (symbols and light box drawing
+// lines) and 0x80-0x8F (quadrant blocks)
+static const u16 glyph_code_symbol[32] = {
+    0x0020, 0x2592, 0x25CB, 0x25D9, 0x2665, 0x2666, 0x2663, 0x2660,
+    0x263A, 0x263B, 0x266A, 0xFFFD, 0x263C, 0xFFFD, 0xFFFD, 0xFFFD,
+    0x2022, 0x2574, 0x2575, 0x2518, 0x2576, 0x2500, 0x2514, 0x2534,
+    0x2577, 0x2510, 0x2502, 0x2524, 0x250C, 0x252C, 0x251C, 0x253C
+};
+
+static const u16 glyph_code_block[16] = {
+    0x0020, 0x259D, 0x2598, 0x2580, 0x2597, 0x2590, 0x259A, 0x259C,
+    0x2596, 0x259E, 0x258C, 0x259B, 0x2584, 0x259F, 0x2599, 0x2588
+};
+
+// The glyphs shared by several code points give the most common one,
+// the inverted copies are read as the normal characters
+u32 charset_code(u8 glyph) {
+    if (glyph == GLYPH_REPLACEMENT) {
+        return 0xFFFD;
+    }
+    if (glyph >= 0x90) {
+        glyph &= 0x7F;
+    }
+    if ((glyph >= 0x20) && (glyph < 0x7F)) {
+        return glyph;
+    }
+    if (glyph < 0x20) {
+        return glyph_code_symbol[glyph];
+    }
+    if (glyph >= 0x80) {
+        return glyph_code_block[glyph - 0x80];
+    }
+    return 0xFFFD;
+}
+
+// Translation tables for the 94 character sets (G0 to G3), generated at
+// compile time: ASCII with the characters in pos replaced by the glyphs
+// for the code points in codes (ASCII code points are kept)
+struct charset_table {
+    u8 map[256];
+
+    constexpr charset_table(const char *pos, const char16_t *codes) : map() {
+        for (int i = 0; i < 256; i++) {
+            map[i] = i;
+        }
+        for (int i = 0; pos[i] != 0; i++) {
+            map[(u8) pos[i]] = (codes[i] < 0x80) ? codes[i] : glyph_lookup(codes[i]);
+        }
+    }
+};
+
+// Positions changed by the National Replacement Character Sets
+#define NRC_POS     "#@[\\]^_`{|}~"
+
+static constexpr charset_table cs_ascii("", u"");
+static constexpr charset_table cs_dec_graphics("_`abcdefghijklmnopqrstuvwxyz{|}~",
+                                               u"\u00A0◆▒␉␌␍␊°±␤␋┘┐┌└┼⎺⎻─⎼⎽├┤┴┬│≤≥π≠£·");
+static constexpr charset_table cs_uk("#", u"£");
+static constexpr charset_table cs_dutch(NRC_POS, u"£¾ĳ½|^_`¨ƒ¼´");
+static constexpr charset_table cs_finnish(NRC_POS, u"#@ÄÖÅÜ_éäöåü");
+static constexpr charset_table cs_french(NRC_POS, u"£à°ç§^_`éùè¨");
+static constexpr charset_table cs_french_ca(NRC_POS, u"#àâçêî_ôéùèû");
+static constexpr charset_table cs_german(NRC_POS, u"#§ÄÖÜ^_`äöüß");
+static constexpr charset_table cs_italian(NRC_POS, u"£§°çé^_ùàòèì");
+static constexpr charset_table cs_norwegian(NRC_POS, u"#ÄÆØÅÜ_äæøåü");
+static constexpr charset_table cs_spanish(NRC_POS, u"£§¡Ñ¿^_`°ñç~");
+static constexpr charset_table cs_swedish(NRC_POS, u"#ÉÄÖÅÜ_éäöåü");
+static constexpr charset_table cs_swiss(NRC_POS, u"ùàéçêîèôäöüû");
+
+// Final characters of the designation sequences (ESC ( F and similar)
+static const struct {
+    char final;
+    const u8 *map;
+} charset_finals[] = {
+    { '0', cs_dec_graphics.map },
+    { 'A', cs_uk.map },
+    { '4', cs_dutch.map },
+    { 'C', cs_finnish.map }, { '5', cs_finnish.map },
+    { 'R', cs_french.map }, { 'f', cs_french.map },
+    { 'Q', cs_french_ca.map }, { '9', cs_french_ca.map },
+    { 'K', cs_german.map },
+    { 'Y', cs_italian.map },
+    { 'E', cs_norwegian.map }, { '6', cs_norwegian.map }, { '`', cs_norwegian.map },
+    { 'Z', cs_spanish.map },
+    { 'H', cs_swedish.map }, { '7', cs_swedish.map },
+    { '=', cs_swiss.map }
+};
+
+// Translation table for a designation final character
+// Returns NULL for ASCII ('B') and for the sets not supported
+const u8 *charset_designate(u8 final) {
+    for (unsigned i = 0; i < sizeof(charset_finals)/sizeof(charset_finals[0]); i++) {
+        if (charset_finals[i].final == final) {
+            return charset_finals[i].map;
+        }
+    }
+    return NULL;
+}
+
+// Identity table, used when a single shift selects ASCII
+const u8 *charset_identity = cs_ascii.map;
@@ -0,0 +1,34 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Character sets
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _CHARSET_H
+#define _CHARSET_H
+
+// Glyph shown for characters that are not in the font
+#define GLYPH_REPLACEMENT   0xBF
+
+// Glyph in the font for a Unicode code point
+extern u8 charset_glyph(u32 cp);
+
+// Unicode code point for a glyph in the font
+extern u32 charset_code(u8 glyph);
+
+// Translation tables for the G0 to G3 character sets
+extern const u8 *charset_designate(u8 final);
+extern const u8 *charset_identity;
+
+#endif
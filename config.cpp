@@ -21,9 +21,12 @@
 
 #include "include.h"
 
-// Configuration screen colors
-static u8 color_cfg_chr = COL_WHITE;
-static u8 color_cfg_bkg = COL_SEMIGREEN;
+// Configuration screen colors (palette indexes)
+static u8 color_cfg_chr = PAL_CFG_FG;
+static u8 color_cfg_bkg = PAL_CFG_BG;
+
+// Palette slots changed by the color fields
+static u8 color_slot[4] = { PAL_DEF_BG, PAL_DEF_FG, PAL_SL_BG, PAL_SL_FG };
 
 // config field definition
 typedef enum { FLD_BOOL, FLD_OPT, FLD_COLOR } FLD_TYPE;
@@ -42,10 +45,33 @@ static const uint baud_value[] = { 9600, 19200, 38400, 57600, 115200 };
 static const char *opt_fmt[] = { "7E1", "7O1", "8N1", NULL };
 static const SERIAL_FMT fmt_value[] = { FMT_7E1, FMT_7O1, FMT_8N1 };
 static const char *opt_yn[] = { "NO ", "YES", NULL };
+static const char *opt_delay[] = { "250 ms ", "500 ms ", "750 ms ", "1000 ms", NULL };
+static const uint delay_value[] = { 250, 500, 750, 1000 };
+static const char *opt_rate[] = { "30/s", "20/s", "15/s", "10/s", " 5/s", NULL };
+static const uint rate_value[] = { 33, 50, 67, 100, 200 };     // interval in ms
+static const char *opt_scan_pfx[] = { "none", "STX ", "SOH ", NULL };
+static const char *scan_pfx_value[] = { "", "\x02", "\x01" };
+static const char *opt_scan_sfx[] = { "none  ", "CR    ", "CR LF ", "TAB   ", "ETX   ", "ETX CR", NULL };
+static const char *scan_sfx_value[] = { "", "\r", "\r\n", "\t", "\x03", "\x03\r" };
 
 // indexes of current serial configuration
 static int baud = 4, fmt = 2;
 
+// indexes of the keyboard auto repeat (typematic) delay and rate
+static int rpt_delay = 3, rpt_rate = 3;
+
+// indexes of the text added to barcode scans
+static int scan_pfx = 0, scan_sfx = 0;
+
+// selected keyboard layout
+static int kbd_layout;
+
+// index of selected screen geometry
+static int geo;
+
+// power saving video profile
+static bool psave;
+
 // config screen fields
 static FLD_DEF fields[] = {
     { 3, 10, "baud", FLD_OPT, &baud,  opt_baud },
@@ -55,10 +81,17 @@ static FLD_DEF fields[] = {
     { 10, 15, "CR = CR LF", FLD_BOOL, &cr_crlf, opt_yn },
     { 11, 15, "LF = CR LF", FLD_BOOL, &lf_crlf, opt_yn },
     {12, 15, "Status Line", FLD_BOOL, &show_sl, opt_yn },
-    { 16, 14, "Screen Bkg", FLD_COLOR, &color_bkg, NULL },
-    { 17, 14, "Screen Chr", FLD_COLOR, &color_chr, NULL },
-    { 18, 14, "Status Bkg", FLD_COLOR, &color_sl_bkg, NULL },
-    { 19, 14, "Status Chr", FLD_COLOR, &color_sl_chr, NULL }
+    { 8, 50, "Repeat delay", FLD_OPT, &rpt_delay, opt_delay },
+    { 9, 50, "Repeat rate", FLD_OPT, &rpt_rate, opt_rate },
+    { 10, 50, "Keyboard", FLD_OPT, &kbd_layout, layout_name },
+    { 12, 50, "Scan prefix", FLD_OPT, &scan_pfx, opt_scan_pfx },
+    { 12, 66, "suffix", FLD_OPT, &scan_sfx, opt_scan_sfx },
+    { 16, 14, "Screen Bkg", FLD_COLOR, &color_slot[0], NULL },
+    { 17, 14, "Screen Chr", FLD_COLOR, &color_slot[1], NULL },
+    { 18, 14, "Status Bkg", FLD_COLOR, &color_slot[2], NULL },
+    { 19, 14, "Status Chr", FLD_COLOR, &color_slot[3], NULL },
+    { 23, 14, "Geometry", FLD_OPT, &geo, geometry_name },
+    { 23, 36, "Power save", FLD_BOOL, &psave, opt_yn }
 };
 #define NFIELDS (sizeof(fields)/sizeof(FLD_DEF))
 
@@ -71,21 +104,34 @@ static bool changed;
 // Local rotines
 static void label_field(FLD_DEF *fld);
 static void update_field(FLD_DEF *fld, bool selected);
+static void show_video_report(void);
+static void show_latency_report(void);
 
 // Enter configuration mode
 void config_enter() {
+    char buf[40];
     cls(color_cfg_bkg, color_cfg_chr);
     write_str(0, 0, "TERMINAL CONFIGURATION (ESC to exit)");
     curfield = 0;
     changed = false;
+    geo = geometry;
+    kbd_layout = layout_get();
+    psave = power_save;
     // draw boxes
     draw_box(1, 0, 5, TEXTW);
     draw_box(6, 0, 8, TEXTW);
     draw_box(14, 0, 7, TEXTW);
+    draw_box(21, 0, 8, TEXTW);
     // write titles
     write_str(2, 2, "SERIAL");
+    show_latency_report();
     write_str(7, 2, "TERMINAL EMULATION");
+    sprintf(buf, "(%u layouts, %u bytes)", NLAYOUT, layout_flash_size());
+    write_str(11, 38, buf);
     write_str(15, 2, "COLORS");
+    write_str(22, 2, "SCREEN");
+    write_str(22, 36, "C: calibrate lowest clock");
+    show_video_report();
     // draw fields
     for (uint ifld = 0; ifld < NFIELDS; ifld++) {
         label_field(&fields[ifld]);
@@ -95,6 +141,11 @@ void config_enter() {
 
 // Leave configuration mode
 void config_leave() {
+    if (geo != geometry) {
+        VideoSetGeometry((GEOMETRY) geo);
+    }
+    VideoPowerSave(psave);
+    layout_select((LAYOUT) kbd_layout);
     cls();
     home();
     show_cursor();
@@ -105,6 +156,39 @@ void config_leave() {
     }
 }
 
+// Show video clock, headroom and bus contention
+static void show_video_report() {
+    char buf[100];
+    for (int i = 0; i < 4; i++) {
+        if (i < 3) {
+            VideoReport(i, buf);
+        } else {
+            BusReport(buf);
+        }
+        // pad to erase a previous longer report
+        int n = strlen(buf);
+        while (n < 72) {
+            buf[n++] = ' ';
+        }
+        buf[n] = 0;
+        write_str(24+i, 4, buf);
+    }
+}
+
+// Show key to wire latency and USB task statistics
+static void show_latency_report() {
+    char buf[100];
+    for (int i = 0; i < 3; i++) {
+        latency_report(i, buf);
+        int n = strlen(buf);
+        while (n < 52) {
+            buf[n++] = ' ';
+        }
+        buf[n] = 0;
+        write_str((i < 2) ? 3+i : 2, 26, buf);
+    }
+}
+
 // Label a field
 //   name: x
 //         ^ c
@@ -144,13 +228,13 @@ static void update_field(FLD_DEF *fld, bool selected) {
             break;
         
         case FLD_COLOR: {
-                uint8_t color = *((uint8_t *) fld->value);
+                uint8_t slot = *((uint8_t *) fld->value);
                 if (selected) {
                     write_str(fld->l, fld->c, "[ ]");
                 } else {
                     write_str(fld->l, fld->c, "   ");
                 }
-                write_str_atr(fld->l, fld->c+1, " ", color, 0);
+                write_str_atr(fld->l, fld->c+1, " ", slot, 0);
             }
             break;
         
@@ -162,7 +246,19 @@ static void update_field(FLD_DEF *fld, bool selected) {
 // Handle keys in config screen
 void config_key(u8 key){
     FLD_DEF *fld = &fields[curfield];
-    if (key == KEY_DWN) {
+    if ((key == 'C') || (key == 'c')) {
+        // calibrate the clock for the current geometry
+        char buf[40];
+        write_str(22, 36, "calibrating...           ");
+        u32 khz = VideoCalibrate();
+        sprintf(buf, "lowest clock %3u MHz     ", khz/1000);
+        write_str(22, 36, buf);
+        show_video_report();
+    } else if ((key == 'Z') || (key == 'z')) {
+        // clear the latency statistics
+        latency_reset();
+        show_latency_report();
+    } else if (key == KEY_DWN) {
         update_field(fld, false);
         if (++curfield == NFIELDS) {
             curfield = 0;
@@ -210,7 +306,10 @@ void config_key(u8 key){
             }
             break;
             case FLD_COLOR: {
-                uint8_t color = *((uint8_t *) fld->value);
+                // the slot is changed in the palette, cells already
+                // using it change color on the next frame
+                uint8_t slot = *((uint8_t *) fld->value);
+                uint8_t color = palette_get(slot);
                 uint idx_color = 0;
                 for (uint i = 0; i < NCOLOR_PAL; i++) {
                     if (color == rpterm_pallet[i]) {
@@ -222,14 +321,14 @@ void config_key(u8 key){
                     if (++idx_color == NCOLOR_PAL) {
                         idx_color = 0;
                     }
-                    *((uint8_t *) fld->value) = rpterm_pallet[idx_color];
+                    palette_set(slot, rpterm_pallet[idx_color]);
                     update_field(fld, true);
                     changed = true;
                 }  else if (key == '-') {
                     if (idx_color-- == 0) {
                         idx_color = NCOLOR_PAL - 1;
                     }
-                    *((uint8_t *) fld->value) = rpterm_pallet[idx_color];
+                    palette_set(slot, rpterm_pallet[idx_color]);
                     update_field(fld, true);
                     changed = true;
                 }
@@ -250,3 +349,19 @@ uint config_getbaudrate() {
 SERIAL_FMT config_getfmt() {
     return fmt_value[fmt];
 }
+
+uint config_getrepeatdelay() {
+    return delay_value[rpt_delay];
+}
+
+uint config_getrepeatrate() {
+    return rate_value[rpt_rate];
+}
+
+const char *config_getscanprefix() {
+    return scan_pfx_value[scan_pfx];
+}
+
+const char *config_getscansuffix() {
+    return scan_sfx_value[scan_sfx];
+}
@@ -25,5 +25,9 @@ extern void config_key(u8 key);
 extern const char *config_getbaud(void);
 extern uint config_getbaudrate(void);
 extern SERIAL_FMT config_getfmt(void);
+extern uint config_getrepeatdelay(void);     // ms before the first repeat
+extern uint config_getrepeatrate(void);      // ms between repeats
+extern const char *config_getscanprefix(void);  // sent before a barcode scan
+extern const char *config_getscansuffix(void);  // sent after a barcode scan
 
 #endif
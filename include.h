@@ -36,6 +36,9 @@
 // usb keyboard
 #include "keybd.h"
 
+// keyboard layouts
+#include "layout.h"
+
 // terminal emulation
 #include "terminal.h"
 
@@ -44,3 +47,21 @@
 
 // video
 #include "video.h"
+
+// scrollback history
+#include "scrollback.h"
+
+// character sets
+#include "charset.h"
+
+// key to wire latency
+#include "latency.h"
+
+// usb mouse
+#include "mouse.h"
+
+// text selection and paste
+#include "selection.h"
+
+// keyboard macros
+#include "macro.h"
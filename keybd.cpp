@@ -10,9 +10,22 @@
  * This file handles the USB keyboard
  * Based in the SDK example for tinyusb v0.13.0
  *
- * The The HID host code in the tinyUSB stack will select the boot protocol and 
- * a zero idle rate (device only send reports if there is a change) when a HID 
- * device is mounted.
+ * The HID host code in the tinyUSB stack is told to leave the devices in the
+ * report protocol (keyb_init) and selects a zero idle rate (device only send
+ * reports if there is a change) when a HID device is mounted. The keyboard
+ * reports are decoded using the report descriptor, so bitmap (NKRO) and
+ * array (6KRO) layouts are handled alike.
+ *
+ * Each HID interface has its own slot, so several keyboards, barcode
+ * scanners and mice (directly or through a hub) can be used at the same
+ * time. Keys are detected per keyboard, the modifiers of all keyboards
+ * are combined.
+ *
+ * A keyboard that sends a long run of keys faster than anyone can type is
+ * taken as a barcode scanner (HID wedge). From its next scan on, its keys
+ * go to a burst buffer that the main loop takes as a whole when the scan
+ * ends, instead of one key at a time from the keyboard buffer. The scan
+ * that shows it is a scanner has already been sent as typed keys.
  * 
  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
@@ -26,36 +39,27 @@
 
 #include "include.h"
 
-#include "keycode_to_ascii.h"
-
-#define MAX_KEY 6   // Maximun number of pressed key in the boot layout report
 
 // Keyboard buffer
+// filled by the USB callbacks and by the auto repeat alarm (interrupt)
 #define KBD_BUFFER_SIZE 100
-static uint8_t buffer_kbd[KBD_BUFFER_SIZE];
-static int buf_kbd_in, buf_kbd_out;
-
+static KEY_EVENT buffer_kbd[KBD_BUFFER_SIZE];
+static uint32_t time_kbd[KBD_BUFFER_SIZE];     // time of the report (for latency measurement)
+static volatile int buf_kbd_in, buf_kbd_out;
+static uint32_t kbd_time;                       // time of the last key taken from the buffer
+static uint32_t report_time;                    // time the current report was received
 
-// Keyboard address and instance (assumes there is only one)
-static uint8_t keybd_dev_addr = 0xFF;
-static uint8_t keybd_instance;
+// Scanner keys that don't fit in the burst buffer go to the keyboard buffer
+// marked with KMOD_SCAN; has_kbd() does not see them, they are taken by
+// get_kbd_burst() after the keys in the burst buffer
+#define KMOD_SCAN   0x80
 
-// Auto repeat control
-#define REPEAT_START    1000
-#define REPEAT_INTERVAL 100
-
-static uint8_t  repeat_keycode [MAX_KEY];
-static uint8_t  repeat_char [MAX_KEY];
-static uint32_t repeat_time [MAX_KEY];
 
 // Caps lock control
-static bool capslock_key_down_in_last_report = false;
-static bool capslock_key_down_in_this_report = false;
 static bool capslock_on = false;
 
-// Keyboard LED control
+// Keyboard LED control (sent to all keyboards)
 static uint8_t leds = 0;
-static uint8_t prev_leds = 0xFF;
 
 //--------------------------------------------------------------------+
 // USB HID
@@ -63,32 +67,143 @@ static uint8_t prev_leds = 0xFF;
 
 #define MAX_REPORT 4
 
-#ifdef LOCALISE_DE
-static uint8_t const keycode2ascii[128][2] = {HID_KEYCODE_TO_ASCII_DE};
-#elif LOCALISE_UK
-static uint8_t const keycode2ascii[128][2] = {HID_KEYCODE_TO_ASCII_UK};
-#elif LOCALISE_US
-static uint8_t const keycode2ascii[128][2] = {HID_KEYCODE_TO_ASCII_US};
-#elif LOCALISE_BR
-static uint8_t const keycode2ascii[160][2] = {HID_KEYCODE_TO_ASCII_BR};
-#else
-static uint8_t const keycode2ascii[128][2] = {HID_KEYCODE_TO_ASCII};
-#endif
+// Set of pressed keys (one bit per usage of the keyboard page)
+typedef struct {
+  uint32_t w[8];
+} KEYSET;
+
+static inline bool keyset_test(KEYSET const *ks, uint8_t usage)
+{
+  return ks->w[usage >> 5] & (1u << (usage & 31));
+}
+
+static inline void keyset_set(KEYSET *ks, uint8_t usage)
+{
+  ks->w[usage >> 5] |= 1u << (usage & 31);
+}
+
+static inline void keyset_clear(KEYSET *ks, uint8_t usage)
+{
+  ks->w[usage >> 5] &= ~(1u << (usage & 31));
+}
 
-#define NKEYS (sizeof(keycode2ascii) / sizeof(keycode2ascii[0]))
+// Keyboard input fields, compiled from the report descriptor at mount
+//   bitmap: count bits, bit i set means usage (usage_min + i) is pressed
+//   array:  count items of size bits, each has the usage of a pressed key
+typedef struct {
+  uint16_t bit;         // position in the report (after the report ID)
+  uint8_t  size;        // bits per item
+  uint8_t  count;       // number of items
+  uint8_t  usage_min;   // usage of the first bit (bitmap) or of logical_min (array)
+  uint8_t  logical_min; // array: range of the values
+  uint8_t  logical_max;
+  uint8_t  report_id;   // 0 if the descriptor has no report IDs
+  bool     array;
+} KBD_FIELD;
+
+#define MAX_KBD_FIELDS 6
+
+// Boot protocol layout: modifier bitmap, reserved byte and 6 key array
+// (keyboard usages 0x00 to 0xDF, the modifiers are only in the bitmap)
+static const KBD_FIELD kbd_boot_field[2] = {
+  { 0, 1, 8, 0xE0, 0, 1, 0, false },
+  { 16, 8, 6, 0x00, 0, 0xDF, 0, true }
+};
+
+// HID interfaces
+// The instance numbers are per device, a slot is found by address and instance
+#define MAX_HID_ITF CFG_TUH_HID
+
+typedef enum { HID_OTHER = 0, HID_KEYBOARD, HID_MOUSE } HID_TYPE;
+
+typedef struct {
+  uint8_t  dev_addr;      // 0 if the slot is free
+  uint8_t  instance;
+  uint8_t  type;          // HID_TYPE
+  uint8_t  leds;          // leds last sent to the keyboard (0xFF: none)
+  uint8_t  led_id;        // report ID of the LED output report (0 if none)
+  uint8_t  led_report[2]; // LED output report being sent (report ID and leds)
+  bool     mouse;         // has mouse reports (counted in mouse_count)
+  uint8_t  report_count;  // reports in the descriptor (usage of each report)
+  tuh_hid_report_info_t report_info[MAX_REPORT];
+  uint8_t  nfields;       // keyboard input fields
+  bool     report_ids;
+  KBD_FIELD field[MAX_KBD_FIELDS];
+  KEYSET   keys;          // keys currently pressed
+  uint32_t key_time;      // time of the last report with a key pressed
+  uint8_t  fast_keys;     // reports in a row with keys pressed quickly
+  bool     scanner;       // the keys come in bursts (barcode scanner)
+  bool     scan_typed;    // this scan is sent as typed keys (another scanner was sending)
+} HID_ITF;
+
+static HID_ITF hid_itf[MAX_HID_ITF];
+static int mouse_count;   // mice connected
+
+// Scanner bursts
+// A keyboard is a scanner after BURST_MIN reports in a row with keys
+// pressed less than BURST_GAP_US apart, a burst ends BURST_END_US after
+// its last key. The burst is taken when it ends or when the buffer is
+// half full, so long scans are not lost; keys that still don't fit wait
+// in the keyboard buffer (burst_spill).
+#define BURST_GAP_US  12000
+#define BURST_MIN     8
+#define BURST_END_US  20000
+#define BURST_SIZE    256
+static KEY_EVENT burst_kbd[BURST_SIZE];
+static int burst_in, burst_out;
+static HID_ITF *burst_itf;      // scanner sending the current burst
+static bool burst_active;       // burst not ended
+static uint32_t burst_last;     // time of the last key of the burst
+static int burst_spill;         // keys of the burst in the keyboard buffer
 
-// Each HID instance has multiple reports
-static uint8_t _report_count[CFG_TUH_HID];
-static tuh_hid_report_info_t _report_info_arr[CFG_TUH_HID][MAX_REPORT];
+// Auto repeat control
+// Like a PC keyboard, only the last key pressed repeats. A hardware alarm
+// fires after the delay and then at the rate selected in the config
+// screen, the main loop does no repeat bookkeeping.
+static uint8_t  repeat_keycode;
+static HID_ITF *repeat_itf;             // keyboard with the key
+static volatile KEY_EVENT repeat_key;
+static alarm_id_t repeat_alarm;
+static bool repeat_enabled = true;      // DECARM
+
+static void process_kbd_report(HID_ITF *itf, uint8_t const *report, uint16_t len);
+static void process_mouse_report(hid_mouse_report_t const *report, uint16_t len);
+
+// Find the slot of an interface
+static HID_ITF *hid_find(uint8_t dev_addr, uint8_t instance)
+{
+  for (int i = 0; i < MAX_HID_ITF; i++)
+  {
+    if ((hid_itf[i].dev_addr == dev_addr) && (hid_itf[i].instance == instance))
+    {
+      return &hid_itf[i];
+    }
+  }
+  return NULL;
+}
 
-static void process_kbd_report(hid_keyboard_report_t const *report);
-static void process_mouse_report(hid_mouse_report_t const *report);
+// Modifiers pressed in all the keyboards (usages 0xE0 to 0xE7)
+static uint8_t kbd_modifiers(void)
+{
+  uint8_t modifier = 0;
+  for (int i = 0; i < MAX_HID_ITF; i++)
+  {
+    if ((hid_itf[i].dev_addr != 0) && (hid_itf[i].type == HID_KEYBOARD))
+    {
+      modifier |= hid_itf[i].keys.w[HID_KEY_CONTROL_LEFT >> 5] & 0xFF;
+    }
+  }
+  return modifier;
+}
 
 
 // Module init
 void keyb_init(void)
 {
     buf_kbd_in = buf_kbd_out = 0;
+
+    // keyboards are decoded from their report descriptor, no need for the boot protocol
+    tuh_hid_set_default_protocol(HID_PROTOCOL_REPORT);
 }
 
 //--------------------------------------------------------------------+
@@ -96,27 +211,35 @@ void keyb_init(void)
 //--------------------------------------------------------------------+
 
 // Put key in the buffer
-static inline void put_kbd(uint8_t key) {
+// Interrupts are disabled, as keys are also put by the repeat alarm
+// Returns false if the buffer is full (key lost)
+static inline bool put_kbd(KEY_EVENT key, uint32_t time) {
+    uint32_t irq = save_and_disable_interrupts();
     buffer_kbd[buf_kbd_in] = key;
+    time_kbd[buf_kbd_in] = time;
     int aux = buf_kbd_in+1;
     if (aux >= KBD_BUFFER_SIZE) {
         aux = 0;
     }
-    if (aux != buf_kbd_out) {
+    bool room = aux != buf_kbd_out;
+    if (room) {
         // buffer not full
         buf_kbd_in = aux;
     }
+    restore_interrupts(irq);
+    return room;
 }
 
-// Test if buffer not empty
+// Test if buffer not empty (a scanner key waiting for its burst is not seen)
 bool has_kbd() {
-    return buf_kbd_in != buf_kbd_out;
+    return (buf_kbd_in != buf_kbd_out) && !(buffer_kbd[buf_kbd_out].mods & KMOD_SCAN);
 }
 
 // Get next key from the buffer
-uint8_t get_kbd() {
+KEY_EVENT get_kbd() {
     if (has_kbd()) {
-        uint8_t key = buffer_kbd[buf_kbd_out];
+        KEY_EVENT key = buffer_kbd[buf_kbd_out];
+        kbd_time = time_kbd[buf_kbd_out];
         int aux = buf_kbd_out+1;
         if (aux >= KBD_BUFFER_SIZE) {
             aux = 0;
@@ -124,8 +247,148 @@ uint8_t get_kbd() {
         buf_kbd_out = aux;
         return key;
     } else {
-        return 0;   // buffer empty
+        return (KEY_EVENT) { 0, 0 };   // buffer empty
+    }
+}
+
+// Time (time_us_32) of the report of the last key returned by get_kbd
+uint32_t get_kbd_time() {
+    return kbd_time;
+}
+
+// Put a scanner key in the burst buffer
+// A scan from a second scanner in the middle of a burst is sent as typed
+// keys. When the buffer is full the keys go to the keyboard buffer, and
+// the next ones too until those are taken, so the scan keeps its order.
+static void put_burst(HID_ITF *itf, KEY_EVENT key) {
+    if (itf->scan_typed || ((burst_itf != NULL) && (burst_itf != itf))) {
+        itf->scan_typed = true;
+        put_kbd(key, report_time);
+        return;
+    }
+    int aux = (burst_in + 1) % BURST_SIZE;
+    if ((aux == burst_out) || (burst_spill > 0)) {
+        key.mods |= KMOD_SCAN;
+        if (put_kbd(key, report_time)) {
+            burst_spill++;
+        }
+    } else {
+        burst_kbd[burst_in] = key;
+        burst_in = aux;
+    }
+    burst_itf = itf;
+    burst_active = true;
+    burst_last = report_time;
+}
+
+// Number of keys in the burst buffer
+static inline int burst_count() {
+    int n = burst_in - burst_out;
+    return (n < 0) ? n + BURST_SIZE : n;
+}
+
+// Test if a burst ended (or is long) and can be taken
+bool has_kbd_burst() {
+    if (!burst_active) {
+        return false;
+    }
+    return ((time_us_32() - burst_last) > BURST_END_US) || (burst_count() >= BURST_SIZE/2);
+}
+
+// Get next key of a burst
+//   returns 1 (key in *key), 0 (no key now) or -1 (end of the burst)
+int get_kbd_burst(KEY_EVENT *key) {
+    if (burst_out != burst_in) {
+        *key = burst_kbd[burst_out];
+        burst_out = (burst_out + 1) % BURST_SIZE;
+        return 1;
     }
+    if (burst_spill > 0) {
+        // keys that did not fit in the burst buffer; keys typed in between
+        // are moved up and stay in the buffer, they wait for the scan
+        uint32_t irq = save_and_disable_interrupts();
+        for (int i = buf_kbd_out; i != buf_kbd_in; i = (i + 1 < KBD_BUFFER_SIZE) ? i + 1 : 0) {
+            if (buffer_kbd[i].mods & KMOD_SCAN) {
+                KEY_EVENT ev = buffer_kbd[i];
+                while (i != buf_kbd_out) {
+                    int prev = (i > 0) ? i - 1 : KBD_BUFFER_SIZE - 1;
+                    buffer_kbd[i] = buffer_kbd[prev];
+                    time_kbd[i] = time_kbd[prev];
+                    i = prev;
+                }
+                buf_kbd_out = (buf_kbd_out + 1 < KBD_BUFFER_SIZE) ? buf_kbd_out + 1 : 0;
+                restore_interrupts(irq);
+                key->code = ev.code;
+                key->mods = ev.mods & ~KMOD_SCAN;
+                burst_spill--;
+                return 1;
+            }
+        }
+        restore_interrupts(irq);
+    }
+    if (burst_active && (burst_spill == 0) && ((time_us_32() - burst_last) > BURST_END_US)) {
+        burst_active = false;
+        burst_itf = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------+
+// Auto repeat
+//--------------------------------------------------------------------+
+
+// Alarm callback (interrupt context)
+// A negative return schedules the next repeat relative to the previous
+// one, so the rate does not drift
+static int64_t repeat_cb(alarm_id_t id, void *user_data)
+{
+  if (repeat_key.code == 0) {
+    return 0;
+  }
+  put_kbd((KEY_EVENT) { repeat_key.code, repeat_key.mods }, time_us_32());
+  return -((int64_t) config_getrepeatrate() * 1000);
+}
+
+// Stop repeating
+static void repeat_stop(void)
+{
+  if (repeat_alarm > 0) {
+    cancel_alarm(repeat_alarm);
+    repeat_alarm = 0;
+  }
+  repeat_keycode = 0;
+  repeat_itf = NULL;
+  repeat_key.code = 0;
+}
+
+// Start repeating a key after the typematic delay
+static void repeat_start(HID_ITF *itf, uint8_t keycode, KEY_EVENT ev)
+{
+  repeat_stop();
+  if (repeat_enabled && (ev.code != 0)) {
+    repeat_keycode = keycode;
+    repeat_itf = itf;
+    repeat_key.mods = ev.mods;
+    repeat_key.code = ev.code;
+    repeat_alarm = add_alarm_in_ms(config_getrepeatdelay(), repeat_cb, NULL, true);
+  }
+}
+
+// Enable or disable auto repeat (DECARM)
+void keyb_autorepeat(bool on)
+{
+  repeat_enabled = on;
+  if (!on) {
+    repeat_stop();
+  }
+}
+
+// Test if a shift key is pressed
+bool keyb_shift(void)
+{
+  uint8_t const modifier = kbd_modifiers();
+  return (modifier & (KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT)) != 0;
 }
 
 //--------------------------------------------------------------------+
@@ -133,85 +396,392 @@ uint8_t get_kbd() {
 //--------------------------------------------------------------------+
 void hid_app_task(void)
 {
-  // update keyboard leds
-  if (keybd_dev_addr != 0xFF)
-  { // only if keyboard attached
-    if (leds != prev_leds)
+  // update keyboard leds, a request that can't be started now
+  // (control transfer in progress) is tried again in the next call
+  for (int i = 0; i < MAX_HID_ITF; i++)
+  {
+    HID_ITF *itf = &hid_itf[i];
+    if ((itf->dev_addr != 0) && (itf->type == HID_KEYBOARD) && (itf->leds != leds))
     {
-      tuh_hid_set_report(keybd_dev_addr, keybd_instance, 0, HID_REPORT_TYPE_OUTPUT, &leds, sizeof(leds));
-      prev_leds = leds;
+      // with report IDs the report starts with its ID
+      // (the buffer is in the slot, the transfer ends after this call)
+      itf->led_report[0] = itf->led_id;
+      itf->led_report[1] = leds;
+      uint8_t skip = (itf->led_id == 0) ? 1 : 0;
+      if (tuh_hid_set_report(itf->dev_addr, itf->instance, itf->led_id, HID_REPORT_TYPE_OUTPUT,
+                             itf->led_report + skip, sizeof(itf->led_report) - skip))
+      {
+        itf->leds = leds;
+      }
     }
+  }
+}
 
-    // auto-repeat keys
-    for (int i = 0; i < MAX_KEY; i++)
+// Number of HID interfaces in use
+int keyb_hid_count(void)
+{
+  int n = 0;
+  for (int i = 0; i < MAX_HID_ITF; i++)
+  {
+    if (hid_itf[i].dev_addr != 0)
     {
-      if (repeat_char[i] && (board_millis() > repeat_time[i]))
-      {
-        put_kbd(repeat_char[i]);
-        repeat_time[i] += REPEAT_INTERVAL;
-      }
+      n++;
     }
   }
+  return n;
 }
 
 //--------------------------------------------------------------------+
 // TinyUSB Callbacks
 //--------------------------------------------------------------------+
 
-// Invoked when device with hid interface is mounted
-void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_report, uint16_t desc_len)
+//--------------------------------------------------------------------+
+// Report descriptor
+//--------------------------------------------------------------------+
+
+// Compile the keyboard input fields of a report descriptor
+// Only the items needed to locate the keyboard page inputs are handled;
+// fields in other pages (consumer keys, vendor data) only move the position
+static void parse_kbd_descriptor(HID_ITF *itf, uint8_t const *desc, uint16_t len)
+{
+  // global items (with a small stack for push/pop)
+  struct {
+    uint16_t usage_page;
+    int32_t  logical_min, logical_max;
+    uint8_t  size, count, report_id;
+  } glb = {0, 0, 0, 0, 0, 0}, stack[2];
+  int sp = 0;
+  // local items
+  uint32_t usage_min = 0, usage_max = 0;
+  bool has_usage = false;
+  // position of the next input field of each report ID
+  uint8_t  pos_id[8];
+  uint16_t pos_bit[8];
+  int npos = 0;
+  bool leds_found = false;
+
+  itf->nfields = 0;
+  itf->report_ids = false;
+  itf->led_id = 0;
+  uint8_t const *end = desc + len;
+  while (desc < end)
+  {
+    uint8_t prefix = *desc++;
+    if (prefix == 0xFE)
+    {
+      // long item, skip
+      if (desc + 2 > end) break;
+      desc += 2 + desc[0];
+      continue;
+    }
+    int size = (prefix & 3) == 3 ? 4 : (prefix & 3);
+    if (desc + size > end) break;
+    uint32_t data = 0;
+    for (int i = 0; i < size; i++)
+    {
+      data |= (uint32_t) desc[i] << (8*i);
+    }
+    int32_t sdata = (size == 1) ? (int8_t) data : (size == 2) ? (int16_t) data : (int32_t) data;
+    desc += size;
+
+    switch (prefix & 0xFC)
+    {
+      // global items
+      case 0x04: glb.usage_page = data; break;
+      case 0x14: glb.logical_min = sdata; break;
+      case 0x24: glb.logical_max = (glb.logical_min >= 0) ? (int32_t) data : sdata; break;
+      case 0x74: glb.size = data; break;
+      case 0x94: glb.count = data; break;
+      case 0x84: glb.report_id = data; itf->report_ids = true; break;
+      case 0xA4: if (sp < 2) stack[sp++] = glb; break;
+      case 0xB4: if (sp > 0) glb = stack[--sp]; break;
+
+      // local items (extended usages have the page in the high 16 bits)
+      case 0x08:
+      case 0x18:
+        if (!has_usage || ((prefix & 0xFC) == 0x18))
+        {
+          usage_min = usage_max = data;
+          has_usage = true;
+        }
+        else if (data == usage_max + 1)
+        {
+          usage_max = data;   // consecutive usages
+        }
+        break;
+      case 0x28: usage_max = data; break;
+
+      // main items
+      case 0x80:
+        {
+          // input: find the position for the report ID
+          int p;
+          for (p = 0; (p < npos) && (pos_id[p] != glb.report_id); p++)
+            ;
+          if (p == npos)
+          {
+            if (npos == 8) break;
+            pos_id[npos] = glb.report_id;
+            pos_bit[npos++] = 0;
+          }
+          uint16_t page = (usage_min > 0xFFFF) ? (usage_min >> 16) : glb.usage_page;
+          bool constant = data & 1;
+          bool variable = data & 2;
+          if (!constant && (page == HID_USAGE_PAGE_KEYBOARD) && (itf->nfields < MAX_KBD_FIELDS) &&
+              (variable ? (glb.size == 1) : (glb.size <= 8)))
+          {
+            KBD_FIELD *fld = &itf->field[itf->nfields++];
+            fld->bit = pos_bit[p];
+            fld->size = glb.size;
+            fld->count = glb.count;
+            fld->usage_min = usage_min & 0xFF;
+            fld->logical_min = glb.logical_min;
+            fld->logical_max = (glb.logical_max > 0xFF) ? 0xFF : glb.logical_max;
+            fld->report_id = glb.report_id;
+            fld->array = !variable;
+          }
+          pos_bit[p] += glb.size * glb.count;
+        }
+        // fall through: the local items are cleared after a main item
+      case 0xB0:
+      case 0xA0:
+      case 0xC0:
+        usage_min = usage_max = 0;
+        has_usage = false;
+        break;
+      case 0x90:
+        // output: the first one in the LED page gives the report ID of the leds
+        if (!leds_found && (((usage_min > 0xFFFF) ? (usage_min >> 16) : glb.usage_page) == HID_USAGE_PAGE_LED))
+        {
+          itf->led_id = glb.report_id;
+          leds_found = true;
+        }
+        usage_min = usage_max = 0;
+        has_usage = false;
+        break;
+    }
+  }
+}
+
+// Read bits from a report
+static inline uint32_t report_bits(uint8_t const *report, uint16_t len, uint16_t bit, uint8_t size)
 {
-  // Report descriptor is also available for use. tuh_hid_parse_report_descriptor()
-  // can be used to parse common/simple enough descriptor.
-  _report_count[instance] = tuh_hid_parse_report_descriptor(_report_info_arr[instance], MAX_REPORT, desc_report, desc_len);
-  // Check if at least one of the reports is for a keyboard
-  for (int i = 0; i < _report_count[instance]; i++) 
-  {
-    if ((_report_info_arr[instance][i].usage_page == HID_USAGE_PAGE_DESKTOP) && 
-        (_report_info_arr[instance][i].usage == HID_USAGE_DESKTOP_KEYBOARD)) 
+  uint32_t val = 0;
+  for (int i = 0; i < size; i++, bit++)
+  {
+    if (((bit >> 3) < len) && (report[bit >> 3] & (1 << (bit & 7))))
     {
-        keybd_dev_addr = dev_addr;
-        keybd_instance = instance;
+      val |= 1u << i;
     }
   }
+  return val;
+}
+
+// Update a key set with the fields of a report
+// Returns false if the report is a rollover error (too many keys pressed)
+static bool decode_kbd_report(KEYSET *keys, KBD_FIELD const *fld, int nfld, uint8_t report_id,
+                              uint8_t const *report, uint16_t len)
+{
+  KEYSET ks = *keys;
+
+  // clear the usages of all the fields before any is set, an array
+  // declared over the whole page also covers the modifier bitmap
+  for (int f = 0; f < nfld; f++)
+  {
+    if (fld[f].report_id != report_id)
+    {
+      continue;
+    }
+    int first = fld[f].usage_min;
+    int last = fld[f].array ? first + fld[f].logical_max - fld[f].logical_min
+                            : first + fld[f].count - 1;
+    for (int u = first; (u <= last) && (u <= 0xFF); u++)
+    {
+      keyset_clear(&ks, u);
+    }
+  }
+
+  for (int f = 0; f < nfld; f++, fld++)
+  {
+    if (fld->report_id != report_id)
+    {
+      continue;
+    }
+    if (fld->array)
+    {
+      for (int i = 0; i < fld->count; i++)
+      {
+        int v = report_bits(report, len, fld->bit + i*fld->size, fld->size);
+        if ((v < fld->logical_min) || (v > fld->logical_max))
+        {
+          continue;     // no key
+        }
+        int usage = fld->usage_min + v - fld->logical_min;
+        if (usage == 0x01)
+        {
+          return false; // ErrorRollOver
+        }
+        if ((usage > 0x03) && (usage <= 0xFF))
+        {
+          keyset_set(&ks, usage);
+        }
+      }
+    }
+    else
+    {
+      // bitmap, whole bytes are copied when aligned
+      for (int i = 0; i < fld->count; )
+      {
+        int u = fld->usage_min + i;
+        if (u > 0xFF)
+        {
+          break;
+        }
+        uint16_t bit = fld->bit + i;
+        if (((bit & 7) == 0) && ((u & 7) == 0) && (i + 8 <= fld->count) && ((bit >> 3) < len))
+        {
+          ks.w[u >> 5] |= (uint32_t) report[bit >> 3] << (u & 31);
+          i += 8;
+        }
+        else
+        {
+          if (report_bits(report, len, bit, 1))
+          {
+            keyset_set(&ks, u);
+          }
+          i++;
+        }
+      }
+    }
+  }
+  *keys = ks;
+  return true;
+}
+
+// Usage of a report, found by its report ID (NULL if not in the descriptor)
+static tuh_hid_report_info_t *hid_report_info(HID_ITF *itf, uint8_t report_id)
+{
+  for (uint8_t i = 0; i < itf->report_count; i++)
+  {
+    if (itf->report_info[i].report_id == report_id)
+    {
+      return &itf->report_info[i];
+    }
+  }
+  return NULL;
+}
+
+// Check if a report is from a mouse collection
+static inline bool hid_mouse_report(tuh_hid_report_info_t const *info)
+{
+  return (info != NULL) && (info->usage_page == HID_USAGE_PAGE_DESKTOP) && (info->usage == HID_USAGE_DESKTOP_MOUSE);
+}
+
+// Invoked when device with hid interface is mounted
+// Interfaces without a free slot are ignored (no reports requested)
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_report, uint16_t desc_len)
+{
+  HID_ITF *itf = hid_find(0, 0);
+  if (itf == NULL)
+  {
+    return;
+  }
+  memset(itf, 0, sizeof(*itf));
+  itf->dev_addr = dev_addr;
+  itf->instance = instance;
+  itf->leds = 0xFF;
+
+  // tuh_hid_parse_report_descriptor() gives the usage of each report (used
+  // for the mouse), the keyboard fields are compiled by parse_kbd_descriptor()
+  itf->report_count = tuh_hid_parse_report_descriptor(itf->report_info, MAX_REPORT, desc_report, desc_len);
+  parse_kbd_descriptor(itf, desc_report, desc_len);
+  if ((itf->nfields != 0) || (tuh_hid_interface_protocol(dev_addr, instance) == HID_ITF_PROTOCOL_KEYBOARD))
+  {
+    itf->type = HID_KEYBOARD;
+  }
+  else if (tuh_hid_interface_protocol(dev_addr, instance) == HID_ITF_PROTOCOL_MOUSE)
+  {
+    // boot mice have a fixed report layout
+    itf->type = HID_MOUSE;
+    tuh_hid_set_protocol(dev_addr, instance, HID_PROTOCOL_BOOT);
+  }
+
+  // a keyboard can also have a mouse collection (keyboards with a touchpad)
+  itf->mouse = (itf->type == HID_MOUSE);
+  for (int i = 0; i < itf->report_count; i++)
+  {
+    itf->mouse |= hid_mouse_report(&itf->report_info[i]);
+  }
+  if (itf->mouse && (mouse_count++ == 0))
+  {
+    mouse_attach(true);
+  }
 
   // request to receive report
   tuh_hid_receive_report(dev_addr, instance);
 }
 
 // Invoked when device with hid interface is un-mounted
+// The keys of a keyboard are released, a key repeating stops
 void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance)
 {
-  keybd_dev_addr = 0xFF; // keyboard not available
+  HID_ITF *itf = hid_find(dev_addr, instance);
+  if (itf == NULL)
+  {
+    return;
+  }
+  if (itf->mouse && (--mouse_count == 0))
+  {
+    mouse_attach(false);
+  }
+  if (repeat_itf == itf)
+  {
+    repeat_stop();
+  }
+  if (burst_itf == itf)
+  {
+    burst_itf = NULL;   // the keys received are still sent
+  }
+  memset(itf, 0, sizeof(*itf));   // free the slot
 }
 
 // Invoked when received report from device via interrupt endpoint
 void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len)
 {
-  uint8_t const rpt_count = _report_count[instance];
-  tuh_hid_report_info_t *rpt_info_arr = _report_info_arr[instance];
+  report_time = time_us_32();
+
+  HID_ITF *itf = hid_find(dev_addr, instance);
+  if (itf == NULL)
+  {
+    return;
+  }
+  if ((itf->type == HID_KEYBOARD) &&
+      !(itf->mouse && itf->report_ids && (len > 0) && hid_mouse_report(hid_report_info(itf, report[0]))))
+  {
+    // keyboard, fields from the report descriptor
+    // (reports of a mouse collection in the keyboard are decoded below)
+    process_kbd_report(itf, report, len);
+    tuh_hid_receive_report(dev_addr, instance);
+    return;
+  }
+  if ((itf->type == HID_MOUSE) && (tuh_hid_get_protocol(dev_addr, instance) == HID_PROTOCOL_BOOT))
+  {
+    // boot mouse, no report ID
+    process_mouse_report((hid_mouse_report_t const *)report, len);
+    tuh_hid_receive_report(dev_addr, instance);
+    return;
+  }
   tuh_hid_report_info_t *rpt_info = NULL;
 
-  if ((rpt_count == 1) && (rpt_info_arr[0].report_id == 0))
+  if ((itf->report_count == 1) && (itf->report_info[0].report_id == 0))
   {
     // Simple report without report ID as 1st byte
-    rpt_info = &rpt_info_arr[0];
+    rpt_info = &itf->report_info[0];
   }
-  else
+  else if (len > 0)
   {
     // Composite report, 1st byte is report ID, data starts from 2nd byte
-    uint8_t const rpt_id = report[0];
-
-    // Find report id in the arrray
-    for (uint8_t i = 0; i < rpt_count; i++)
-    {
-      if (rpt_id == rpt_info_arr[i].report_id)
-      {
-        rpt_info = &rpt_info_arr[i];
-        break;
-      }
-    }
-
+    rpt_info = hid_report_info(itf, report[0]);
     report++;
     len--;
   }
@@ -220,14 +790,9 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
   {
     switch (rpt_info->usage)
     {
-      case HID_USAGE_DESKTOP_KEYBOARD:
-        // Assume keyboard follow boot report layout
-        process_kbd_report((hid_keyboard_report_t const *)report);
-        break;
-
       case HID_USAGE_DESKTOP_MOUSE:
         // Assume mouse follow boot report layout
-        process_mouse_report((hid_mouse_report_t const *)report);
+        process_mouse_report((hid_mouse_report_t const *)report, len);
         break;
 
       default:
@@ -243,37 +808,85 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
 // Keyboard
 //--------------------------------------------------------------------+
 
-// look up key in a report
-static inline bool find_key_in_report(hid_keyboard_report_t const *report, uint8_t keycode)
+// process keyboard report
+// The pressed keys are decoded into a key set, the keys pressed and released
+// since the last report are found by comparing the sets
+static void process_kbd_report(HID_ITF *itf, uint8_t const *report, uint16_t len)
 {
-  for (uint8_t i = 0; i < MAX_KEY; i++)
+  KBD_FIELD const *fld = itf->field;
+  int nfld = itf->nfields;
+  uint8_t report_id = 0;
+  if ((nfld == 0) || (tuh_hid_get_protocol(itf->dev_addr, itf->instance) == HID_PROTOCOL_BOOT))
+  {
+    // boot protocol
+    fld = kbd_boot_field;
+    nfld = 2;
+  }
+  else if (itf->report_ids)
   {
-    if (report->keycode[i] == keycode)
+    // 1st byte is report ID
+    if (len == 0)
     {
-      return true;
+      return;
     }
+    report_id = *report++;
+    len--;
   }
 
-  return false;
-}
+  KEYSET keys = itf->keys;
+  if (!decode_kbd_report(&keys, fld, nfld, report_id, report, len))
+  {
+    return;   // rollover, keep the previous state
+  }
+  KEYSET down;
+  for (int w = 0; w < 8; w++)
+  {
+    down.w[w] = keys.w[w] & ~itf->keys.w[w];
+  }
+  itf->keys = keys;
+  uint8_t const modifier = kbd_modifiers();
 
-// process keyboard report
-static void process_kbd_report(hid_keyboard_report_t const *report)
-{
-  static hid_keyboard_report_t prev_report = {0, 0, {0}}; // previous report to check key released
+  // stop the auto repeat if the key was released
+  if ((repeat_itf == itf) && !keyset_test(&keys, repeat_keycode))
+  {
+    repeat_stop();
+  }
 
-  // clear released keys in the auto repeat control
-  for (int i = 0; i < MAX_KEY; i++)
+  // find out if this is a scanner
+  bool pressed = false;
+  for (int w = 0; w < (HID_KEY_CONTROL_LEFT >> 5); w++)
   {
-    if (repeat_keycode[i] && !find_key_in_report(report, repeat_keycode[i])) {
-      repeat_keycode[i] = 0;
-      repeat_char[i] = 0;
+    pressed |= down.w[w] != 0;
+  }
+  // (a run of fast keys makes it a scanner from the next scan on, the
+  // keys of this scan have already gone as typed keys)
+  if (pressed)
+  {
+    uint32_t gap = report_time - itf->key_time;
+    if (gap > BURST_END_US)
+    {
+      itf->scan_typed = false;    // a new scan
     }
+    if (!itf->scanner)
+    {
+      if ((itf->fast_keys >= BURST_MIN) && (gap > BURST_END_US))
+      {
+        itf->scanner = true;
+      }
+      else if (gap < BURST_GAP_US)
+      {
+        itf->fast_keys += (itf->fast_keys < BURST_MIN) ? 1 : 0;
+      }
+      else
+      {
+        itf->fast_keys = 0;
+      }
+    }
+    itf->key_time = report_time;
   }
 
   // Check caps lock
-  capslock_key_down_in_this_report = find_key_in_report(report, HID_KEY_CAPS_LOCK);
-  if (capslock_key_down_in_this_report && !capslock_key_down_in_last_report)
+  if (keyset_test(&down, HID_KEY_CAPS_LOCK))
   {
     // CAPS LOCK was pressed
     capslock_on = !capslock_on;
@@ -287,84 +900,117 @@ static void process_kbd_report(hid_keyboard_report_t const *report)
     }
   }
 
-  // check other pressed keys
-  for (uint8_t i = 0; i < MAX_KEY; i++)
+  // check other pressed keys (modifiers are in the last words)
+  for (int w = 0; w < (HID_KEY_CONTROL_LEFT >> 5); w++)
   {
-    uint8_t key = report->keycode[i];
-    if ((key != 0) && (key != HID_KEY_CAPS_LOCK) && !find_key_in_report(&prev_report, key)) // ignore fillers, Caps lock and keys already pressed
+    uint32_t bits = down.w[w];
+    while (bits != 0)
     {
-      // Find corresponding ASCII code
-      uint8_t ch = (key < NKEYS) ? keycode2ascii[key][0] : 0; // unshifted key code, to test for letters
-      bool const is_ctrl = report->modifier & (KEYBOARD_MODIFIER_LEFTCTRL | KEYBOARD_MODIFIER_RIGHTCTRL);
-      bool is_shift = report->modifier & (KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT);
-      bool is_alt = report->modifier & (KEYBOARD_MODIFIER_LEFTALT | KEYBOARD_MODIFIER_RIGHTALT);
-      if (capslock_on && (ch >= 'a') && (ch <= 'z'))
+      uint8_t key = (w << 5) + __builtin_ctz(bits);
+      bits &= bits - 1;
+      if (key == HID_KEY_CAPS_LOCK)
       {
-        // capslock affects only letters
-        is_shift = !is_shift;
+        continue;
       }
-      ch = (key < NKEYS) ? keycode2ascii[key][is_shift ? 1 : 0] : 0;
-      if (is_ctrl)
+      // Find corresponding code in the selected layout
+      // (right Alt is AltGr in layouts that have it)
+      bool const is_ctrl = modifier & (KEYBOARD_MODIFIER_LEFTCTRL | KEYBOARD_MODIFIER_RIGHTCTRL);
+      bool const is_shift = modifier & (KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT);
+      bool const is_altgr = (modifier & KEYBOARD_MODIFIER_RIGHTALT) && layout_has_altgr();
+      bool const is_alt = (modifier & KEYBOARD_MODIFIER_LEFTALT) ||
+                          ((modifier & KEYBOARD_MODIFIER_RIGHTALT) && !is_altgr);
+      uint8_t mods = (is_shift ? KMOD_SHIFT : 0) | (is_alt ? KMOD_ALT : 0) | (is_ctrl ? KMOD_CTRL : 0);
+      if ((key >= HID_KEY_KEYPAD_DIVIDE) && (key <= HID_KEY_KEYPAD_DECIMAL))
       {
-        // control char
-        if ((ch >= 0x60) && (ch <= 0x7F))
+        mods |= KMOD_KEYPAD;
+      }
+
+      // dead keys are combined with the next key
+      uint8_t out[2];
+      int n = layout_compose(layout_key(key, is_shift, is_altgr, capslock_on), out);
+
+      KEY_EVENT ev = { 0, 0 };
+      for (int i = 0; i < n; i++)
+      {
+        uint8_t ch = out[i];
+        if (is_ctrl)
         {
-          ch = ch - 0x60;
+          // control char
+          if ((ch >= 0x60) && (ch <= 0x7F))
+          {
+            ch = ch - 0x60;
+          }
+          else if ((ch >= 0x40) && (ch <= 0x5F))
+          {
+            ch = ch - 0x40;
+          }
         }
-        else if ((ch >= 0x40) && (ch <= 0x5F))
+        if (is_alt)
         {
-          ch = ch - 0x40;
+          // local functions, other keys are sent with the Alt modifier
+          switch (ch) 
+          {
+            case 'c': case 'C':
+              ch = KEY_ALT_C;
+              break;
+            case 'l': case 'L':
+              ch = KEY_ALT_L;
+              break;
+            case 'r': case 'R':
+              ch = KEY_ALT_R;
+              break;
+            case 't': case 'T':
+              ch = KEY_ALT_T;
+              break;
+            case 's': case 'S':
+              ch = KEY_ALT_S;
+              break;
+            case 'v': case 'V':
+              ch = KEY_ALT_V;
+              break;
+            case 'p': case 'P':
+              ch = KEY_ALT_P;
+              break;
+            case 'm': case 'M':
+              ch = KEY_ALT_M;
+              break;
+          }
         }
-      }
-      if (is_alt)
-      {
-        switch (ch) 
+
+        // store the key
+        ev.code = ch;
+        ev.mods = mods;
+        if (itf->scanner)
         {
-          case 'c': case 'C':
-            ch = KEY_ALT_C;
-            break;
-          case 'l': case 'L':
-            ch = KEY_ALT_L;
-            break;
-          case 'r': case 'R':
-            ch = KEY_ALT_R;
-            break;
-          case 't': case 'T':
-            ch = KEY_ALT_T;
-            break;
+          put_burst(itf, ev);
         }
-      }
-
-      // record key for auto repeat
-      for (int j = 0; j < MAX_KEY; j++)
-      {
-        if (repeat_keycode[j] == 0)
+        else
         {
-          repeat_keycode[j] = key;
-          repeat_char[j] = ch;
-          repeat_time[j] = board_millis() + REPEAT_START;
-          break;
+          put_kbd (ev, report_time);
         }
       }
 
-      // store the key
-      put_kbd (ch);
+      // the last key pressed is the one that repeats (scanners don't repeat)
+      if (!itf->scanner)
+      {
+        repeat_start(itf, key, ev);
+      }
     }
   }
-
-  // save current status
-  prev_report = *report;
-  capslock_key_down_in_last_report = capslock_key_down_in_this_report;
 }
 
 //--------------------------------------------------------------------+
 // Mouse
 //--------------------------------------------------------------------+
 
-void cursor_movement(int8_t x, int8_t y, int8_t wheel)
-{
-}
-
-static void process_mouse_report(hid_mouse_report_t const *report)
+// The boot report has 3 bytes (buttons and movement), the wheel is in the
+// 4th byte when the mouse sends it
+static void process_mouse_report(hid_mouse_report_t const *report, uint16_t len)
 {
+  if (len < 3)
+  {
+    return;
+  }
+  int8_t wheel = (len < 4) ? 0 : report->wheel;
+  mouse_report(report->buttons, report->x, report->y, wheel);
 }
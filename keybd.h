@@ -36,17 +36,61 @@
 #define KEY_F9 0x8E
 #define KEY_F10 0x8F
 
+// Latin-1 characters 0xA0 to 0xFF (sent as UTF-8)
+#define KEY_LATIN1 0x90     // 0x90 to 0xEF
+
 // Alt Keys
 #define KEY_ALT_C 0xF0      // Config
 #define KEY_ALT_L 0xF1      // Local <-> on Line
 #define KEY_ALT_R 0xF2      // Record file
 #define KEY_ALT_T 0xF3      // Transmit file
+#define KEY_ALT_S 0xF6      // Search history
+#define KEY_ALT_V 0xFD      // Select text with the keyboard
+#define KEY_ALT_P 0xFE      // Paste
+#define KEY_ALT_M 0xFF      // Record a macro
+
+// Local keys
+#define KEY_SH_PGUP 0xF4    // Scrollback page up
+#define KEY_SH_PGDN 0xF5    // Scrollback page down
+
+// More special keys
+#define KEY_INS 0xF7
+#define KEY_DEL 0xF8
+#define KEY_PGUP 0xF9
+#define KEY_PGDN 0xFA
+#define KEY_F11 0xFB
+#define KEY_F12 0xFC
+
+// Key event: code and the modifiers pressed with the key
+// (control characters already have Ctrl applied to the code)
+typedef struct {
+    uint8_t code;
+    uint8_t mods;
+} KEY_EVENT;
 
+#define KMOD_SHIFT  0x01
+#define KMOD_ALT    0x02
+#define KMOD_CTRL   0x04
+#define KMOD_KEYPAD 0x08    // key in the numeric keypad
 
 // Keyboard buffer access
 extern void keyb_init(void);
 extern bool has_kbd(void);
-extern uint8_t get_kbd(void);
+extern KEY_EVENT get_kbd(void);
+extern uint32_t get_kbd_time(void);
+
+// Barcode scanner bursts
+extern bool has_kbd_burst(void);
+extern int get_kbd_burst(KEY_EVENT *key);
+
+// Auto repeat on/off (DECARM)
+extern void keyb_autorepeat(bool on);
+
+// A shift key is pressed
+extern bool keyb_shift(void);
+
+// Number of HID interfaces in use (keyboards, mice and others)
+extern int keyb_hid_count(void);
 
 // "Tasks" (rotines that will be continuous called in the main loop)
 extern void cdc_task(void);
@@ -24,13 +24,14 @@
 
 /*--------------------------------------------------------------------
  * KEYCODE to Ascii Conversion
- *  Expand to array of [128][2] (ascii without shift, ascii with shift)
+ *  Expand to array of [n][3] (ascii without shift, ascii with shift,
+ *  ascii with AltGr), a missing AltGr column is zero
  *
- * Usage: example to convert ascii from keycode (key) and shift modifier (shift).
- * Here we assume key < 128 ( printable )
+ *  Besides ASCII and the special keys (keybd.h) the tables can have
+ *  Latin-1 characters (L1) and dead keys (DEAD_xxx), see layout.h
  *
- *  uint8_t const conv_table[128][2] =  { HID_KEYCODE_TO_ASCII };
- *  char ch = shift ? conv_table[chr][1] : conv_table[chr][0];
+ *  The tables are only used at compile time, to build the compact
+ *  tables in layout.cpp
  *
  *--------------------------------------------------------------------*/
 
@@ -110,18 +111,18 @@
     {KEY_F9,  0      }, /* 0x42 */ \
     {KEY_F10, 0      }, /* 0x43 */ \
                                    \
-    {0     , 0      }, /* 0x44 */ \
-    {0     , 0      }, /* 0x45 */ \
+    {KEY_F11, 0      }, /* 0x44 F11 */ \
+    {KEY_F12, 0      }, /* 0x45 F12 */ \
     {0     , 0      }, /* 0x46 */ \
     {0     , 0      }, /* 0x47 */ \
     {0     , 0      }, /* 0x48 */ \
-    {0     , 0      }, /* 0x49 */ \
+    {KEY_INS , 0      }, /* 0x49 INSERT */ \
                                    \
     {KEY_HOME, 0      }, /* 0x4a HOME    */ \
-    {0       , 0      }, /* 0x4b PAGE UP */ \
-    {0x7F    , 0      }, /* 0x4c DELETE  */ \
+    {KEY_PGUP, KEY_SH_PGUP }, /* 0x4b PAGE UP */ \
+    {KEY_DEL , 0      }, /* 0x4c DELETE */ \
     {KEY_END , 0      }, /* 0x4d END     */ \
-    {0       , 0      }, /* 0x4e PAGE DN */ \
+    {KEY_PGDN, KEY_SH_PGDN }, /* 0x4e PAGE DN */ \
     {KEY_RGT , 0      }, /* 0x4f RIGHT   */ \
     {KEY_LFT , 0      }, /* 0x50 LEFT    */ \
     {KEY_DWN , 0      }, /* 0x51 DOWN    */ \
@@ -145,6 +146,9 @@
     {'9'   , 0      }, /* 0x61 */ \
     {'0'   , 0      }, /* 0x62 */ \
     {'0'   , 0      }, /* 0x63 */ \
+    {'\\'  , '|'    }, /* 0x64 */ \
+    {0     , 0      }, /* 0x65 */ \
+    {0     , 0      }, /* 0x66 */ \
     {'='   , '='    }, /* 0x67 */ \
 
 
@@ -185,7 +189,7 @@
     {'z'   , 'Z'    }, /* 0x1d */ \
     {'1'   , '!'    }, /* 0x1e */ \
     {'2'   , '\"'   }, /* 0x1f */ \
-    {'3'   , '#'    }, /* 0x20 */ \
+    {'3'   , L1(0xA3)}, /* 0x20 £ */ \
     {'4'   , '$'    }, /* 0x21 */ \
     {'5'   , '%'    }, /* 0x22 */ \
     {'6'   , '^'    }, /* 0x23 */ \
@@ -206,7 +210,7 @@
     {'#'   , '~'    }, /* 0x32 */ \
     {';'   , ':'    }, /* 0x33 */ \
     {'\''  , '@'    }, /* 0x34 */ \
-    {'`'   , '~'    }, /* 0x35 */ \
+    {'`'   , L1(0xAC)}, /* 0x35 ¬ */ \
     {','   , '<'    }, /* 0x36 */ \
     {'.'   , '>'    }, /* 0x37 */ \
     {'/'   , '?'    }, /* 0x38 */ \
@@ -224,18 +228,18 @@
     {KEY_F9,  0      }, /* 0x42 */ \
     {KEY_F10, 0      }, /* 0x43 */ \
                                    \
-    {0     , 0      }, /* 0x44 */ \
-    {0     , 0      }, /* 0x45 */ \
+    {KEY_F11, 0      }, /* 0x44 F11 */ \
+    {KEY_F12, 0      }, /* 0x45 F12 */ \
     {0     , 0      }, /* 0x46 */ \
     {0     , 0      }, /* 0x47 */ \
     {0     , 0      }, /* 0x48 */ \
-    {0     , 0      }, /* 0x49 */ \
+    {KEY_INS , 0      }, /* 0x49 INSERT */ \
                                    \
     {KEY_HOME, 0      }, /* 0x4a HOME    */ \
-    {0       , 0      }, /* 0x4b PAGE UP */ \
-    {0x7F    , 0      }, /* 0x4c DELETE  */ \
+    {KEY_PGUP, KEY_SH_PGUP }, /* 0x4b PAGE UP */ \
+    {KEY_DEL , 0      }, /* 0x4c DELETE */ \
     {KEY_END , 0      }, /* 0x4d END     */ \
-    {0       , 0      }, /* 0x4e PAGE DN */ \
+    {KEY_PGDN, KEY_SH_PGDN }, /* 0x4e PAGE DN */ \
     {KEY_RGT , 0      }, /* 0x4f RIGHT   */ \
     {KEY_LFT , 0      }, /* 0x50 LEFT    */ \
     {KEY_DWN , 0      }, /* 0x51 DOWN    */ \
@@ -286,7 +290,7 @@
      {'j'   , 'J'   ,0 }, /* 0x0d */ \
      {'k'   , 'K'   ,0 }, /* 0x0e */ \
      {'l'   , 'L'   ,0 }, /* 0x0f */ \
-     {'m'   , 'M'   ,0 }, /* 0x10 */ \
+     {'m'   , 'M'   ,L1(0xB5) }, /* 0x10 µ */ \
      {'n'   , 'N'   ,0 }, /* 0x11 */ \
      {'o'   , 'O'   ,0 }, /* 0x12 */ \
      {'p'   , 'P'   ,0 }, /* 0x13 */ \
@@ -301,8 +305,8 @@
      {'z'   , 'Z'   ,0 }, /* 0x1c */ \
      {'y'   , 'Y'   ,0 }, /* 0x1d */ \
      {'1'   , '!'   ,0 }, /* 0x1e */ \
-     {'2'   , '\"'  ,0 }, /* 0x1f */ \
-     {'3'   , 0     ,0 }, /* 0x20 */ \
+     {'2'   , '\"'  ,L1(0xB2) }, /* 0x1f ² */ \
+     {'3'   , L1(0xA7),L1(0xB3) }, /* 0x20 § ³ */ \
      {'4'   , '$'   ,0 }, /* 0x21 */ \
      {'5'   , '%'   ,0 }, /* 0x22 */ \
      {'6'   , '&'   ,0 }, /* 0x23 */ \
@@ -315,15 +319,15 @@
      {'\b'  , '\b'  ,0 }, /* 0x2a */ \
      {'\t'  , '\t'  ,0 }, /* 0x2b */ \
      {' '   , ' '   ,0 }, /* 0x2c */ \
-     { 0    , '?'   ,'\\' }, /* 0x2d  ß */ \
-     {','   , '\''  ,0 }, /* 0x2e */ \
-     { 0    , 0     ,0 }, /* 0x2f */ \
+     {L1(0xDF), '?'  ,'\\' }, /* 0x2d ß */ \
+     {DEAD_ACUTE, DEAD_GRAVE,0 }, /* 0x2e ´ ` */ \
+     {L1(0xFC), L1(0xDC),0 }, /* 0x2f ü */ \
      {'+'   , '*'   ,'~' }, /* 0x30 */ \
      {'#'   , '\''   ,0 }, /* 0x31 */ \
      {'#'   , '~'   ,0 }, /* 0x32 */ \
-     { 0    , 0     ,0 }, /* 0x33 */ \
-     { 0    , 0     ,0 }, /* 0x34 */ \
-     {'`'   , '~'   ,0 }, /* 0x35 */ \
+     {L1(0xF6), L1(0xD6),0 }, /* 0x33 ö */ \
+     {L1(0xE4), L1(0xC4),0 }, /* 0x34 ä */ \
+     {DEAD_CIRC, L1(0xB0),0 }, /* 0x35 ^ ° */ \
      {','   , ';'   ,0 }, /* 0x36 */ \
      {'.'   , ':'   ,0 }, /* 0x37 */ \
      {'-'   , '_'   ,0 }, /* 0x38 */ \
@@ -341,18 +345,18 @@
     {KEY_F9,  0      }, /* 0x42 */ \
     {KEY_F10, 0      }, /* 0x43 */ \
                                    \
-     {0     , 0     ,0 }, /* 0x44 */ \
-     {0     , 0     ,0 }, /* 0x45 */ \
+     {KEY_F11, 0      }, /* 0x44 F11 */ \
+     {KEY_F12, 0      }, /* 0x45 F12 */ \
      {0     , 0     ,0 }, /* 0x46 */ \
      {0     , 0     ,0 }, /* 0x47 */ \
      {0     , 0     ,0 }, /* 0x48 */ \
-     {0x16     , 0     ,0 }, /* 0x49 INS   */ \
+     {KEY_INS , 0      }, /* 0x49 INSERT */ \
                                    \
     {KEY_HOME, 0      }, /* 0x4a HOME    */ \
-    {0       , 0      }, /* 0x4b PAGE UP */ \
-    {0x7F    , 0      }, /* 0x4c DELETE  */ \
+    {KEY_PGUP, KEY_SH_PGUP }, /* 0x4b PAGE UP */ \
+    {KEY_DEL , 0      }, /* 0x4c DELETE */ \
     {KEY_END , 0      }, /* 0x4d END     */ \
-    {0       , 0      }, /* 0x4e PAGE DN */ \
+    {KEY_PGDN, KEY_SH_PGDN }, /* 0x4e PAGE DN */ \
     {KEY_RGT , 0      }, /* 0x4f RIGHT   */ \
     {KEY_LFT , 0      }, /* 0x50 LEFT    */ \
     {KEY_DWN , 0      }, /* 0x51 DOWN    */ \
@@ -394,7 +398,7 @@
     {'b'   , 'B'    }, /* 0x05 */ \
     {'c'   , 'C'    }, /* 0x06 */ \
     {'d'   , 'D'    }, /* 0x07 */ \
-    {'e'   , 'E'    }, /* 0x08 */ \
+    {'e'   , 'E'   , L1(0xB0)}, /* 0x08 ° */ \
     {'f'   , 'F'    }, /* 0x09 */ \
     {'g'   , 'G'    }, /* 0x0a */ \
     {'h'   , 'H'    }, /* 0x0b */ \
@@ -406,22 +410,22 @@
     {'n'   , 'N'    }, /* 0x11 */ \
     {'o'   , 'O'    }, /* 0x12 */ \
     {'p'   , 'P'    }, /* 0x13 */ \
-    {'q'   , 'Q'    }, /* 0x14 */ \
+    {'q'   , 'Q'   , '/' }, /* 0x14 */ \
     {'r'   , 'R'    }, /* 0x15 */ \
     {'s'   , 'S'    }, /* 0x16 */ \
     {'t'   , 'T'    }, /* 0x17 */ \
     {'u'   , 'U'    }, /* 0x18 */ \
     {'v'   , 'V'    }, /* 0x19 */ \
-    {'w'   , 'W'    }, /* 0x1a */ \
+    {'w'   , 'W'   , '?' }, /* 0x1a */ \
     {'x'   , 'X'    }, /* 0x1b */ \
     {'y'   , 'Y'    }, /* 0x1c */ \
     {'z'   , 'Z'    }, /* 0x1d */ \
-    {'1'   , '!'    }, /* 0x1e */ \
-    {'2'   , '@'    }, /* 0x1f */ \
-    {'3'   , '#'    }, /* 0x20 */ \
-    {'4'   , '$'    }, /* 0x21 */ \
-    {'5'   , '%'    }, /* 0x22 */ \
-    {'6'   , 0      }, /* 0x23  6 trema */ \
+    {'1'   , '!'   , L1(0xB9)}, /* 0x1e ¹ */ \
+    {'2'   , '@'   , L1(0xB2)}, /* 0x1f ² */ \
+    {'3'   , '#'   , L1(0xB3)}, /* 0x20 ³ */ \
+    {'4'   , '$'   , L1(0xA3)}, /* 0x21 £ */ \
+    {'5'   , '%'   , L1(0xA2)}, /* 0x22 ¢ */ \
+    {'6'   , DEAD_DIAER, L1(0xAC)}, /* 0x23 6 trema ¬ */ \
     {'7'   , '&'    }, /* 0x24 */ \
     {'8'   , '*'    }, /* 0x25 */ \
     {'9'   , '('    }, /* 0x26 */ \
@@ -432,13 +436,13 @@
     {'\t'  , '\t'   }, /* 0x2b */ \
     {' '   , ' '    }, /* 0x2c */ \
     {'-'   , '_'    }, /* 0x2d */ \
-    {'='   , '+'    }, /* 0x2e */ \
-    {'\''  , '`'    }, /* 0x2f agudo grave*/ \
-    {'['   , '{'    }, /* 0x30 */ \
-    {']'   , '}'    }, /* 0x31 */ \
+    {'='   , '+'   , L1(0xA7)}, /* 0x2e § */ \
+    {DEAD_ACUTE, DEAD_GRAVE}, /* 0x2f agudo grave */ \
+    {'['   , '{'   , L1(0xAA)}, /* 0x30 ª */ \
+    {']'   , '}'   , L1(0xBA)}, /* 0x31 º */ \
     { 0    ,  0     }, /* 0x32 */ \
-    {'c'   , 'C'    }, /* 0x33 c cedilha */ \
-    {'~'   , '^'    }, /* 0x34 til circunflexo */ \
+    {L1(0xE7), L1(0xC7)}, /* 0x33 c cedilha */ \
+    {DEAD_TILDE, DEAD_CIRC}, /* 0x34 til circunflexo */ \
     {'\''  , '\"'   }, /* 0x35 */ \
     {','   , '<'    }, /* 0x36 */ \
     {'.'   , '>'    }, /* 0x37 */ \
@@ -457,18 +461,18 @@
     {KEY_F9,  0      }, /* 0x42 */ \
     {KEY_F10, 0      }, /* 0x43 */ \
                                    \
-    {0     , 0      }, /* 0x44 F11 */ \
-    {0     , 0      }, /* 0x45 F12 */ \
+    {KEY_F11, 0      }, /* 0x44 F11 */ \
+    {KEY_F12, 0      }, /* 0x45 F12 */ \
     {0     , 0      }, /* 0x46 */ \
     {0     , 0      }, /* 0x47 */ \
     {0     , 0      }, /* 0x48 */ \
-    {0     , 0      }, /* 0x49 */ \
+    {KEY_INS , 0      }, /* 0x49 INSERT */ \
                                    \
     {KEY_HOME, 0      }, /* 0x4a HOME    */ \
-    {0       , 0      }, /* 0x4b PAGE UP */ \
-    {0x7F    , 0      }, /* 0x4c DELETE  */ \
+    {KEY_PGUP, KEY_SH_PGUP }, /* 0x4b PAGE UP */ \
+    {KEY_DEL , 0      }, /* 0x4c DELETE */ \
     {KEY_END , 0      }, /* 0x4d END     */ \
-    {0       , 0      }, /* 0x4e PAGE DN */ \
+    {KEY_PGDN, KEY_SH_PGDN }, /* 0x4e PAGE DN */ \
     {KEY_RGT , 0      }, /* 0x4f RIGHT   */ \
     {KEY_LFT , 0      }, /* 0x50 LEFT    */ \
     {KEY_DWN , 0      }, /* 0x51 DOWN    */ \
@@ -0,0 +1,134 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Key to wire latency measurement
+ *
+ * Each HID report is timestamped when tinyUSB delivers it, the key carries
+ * the time through the keyboard buffer and the time it was handled by the
+ * main loop is attached to the last byte of its sequence in the TX buffer.
+ * When that byte is written to the UART the three times are recorded here.
+ *
+ * The USB polling delay (the time between the key press and the report,
+ * up to the endpoint interval) happens before the first timestamp and is
+ * not measured.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "include.h"
+
+// Histogram of the total latency
+// Buckets are logarithmic, 4 per power of two (resolution better than 25%):
+// values below 8 us have their own bucket, above that the bucket is given
+// by the position of the highest bit and the two bits that follow it
+#define LAT_SUB     4
+#define LAT_NBUCKET (4 + 30*LAT_SUB)
+static u32 lat_hist[LAT_NBUCKET];
+static u32 lat_count;
+static u32 lat_max;
+
+// Sum of the times in each stage, for the averages
+static u64 lat_sum_key;     // report to main loop
+static u64 lat_sum_wire;    // main loop to UART
+
+// USB tasks (tuh_task and hid_app_task), polling each HID interface
+// delays the main loop
+static u64 usb_sum;
+static u32 usb_count;
+static u32 usb_max;
+
+// Bucket for a value
+static int lat_bucket(u32 us) {
+    if (us < 8) {
+        return us >> 1;
+    }
+    int msb = 31 - __builtin_clz(us);
+    return 4 + (msb - 3)*LAT_SUB + ((us >> (msb - 2)) & 3);
+}
+
+// Upper limit of a bucket
+static u32 lat_bucket_top(int b) {
+    if (b < 4) {
+        return 2*b + 1;
+    }
+    int msb = (b - 4) / LAT_SUB + 3;
+    int sub = (b - 4) % LAT_SUB;
+    return ((u32) (4 + sub + 1) << (msb - 2)) - 1;
+}
+
+// Record the times of a key
+void latency_record(u32 t_report, u32 t_key, u32 t_wire) {
+    u32 total = t_wire - t_report;
+    lat_hist[lat_bucket(total)]++;
+    lat_count++;
+    if (total > lat_max) {
+        lat_max = total;
+    }
+    lat_sum_key += t_key - t_report;
+    lat_sum_wire += t_wire - t_key;
+}
+
+// Record the time of the USB tasks
+void latency_usb_poll(u32 us) {
+    usb_sum += us;
+    usb_count++;
+    if (us > usb_max) {
+        usb_max = us;
+    }
+}
+
+// Clear the statistics
+void latency_reset() {
+    memset(lat_hist, 0, sizeof(lat_hist));
+    lat_count = lat_max = 0;
+    lat_sum_key = lat_sum_wire = 0;
+    usb_sum = 0;
+    usb_count = usb_max = 0;
+}
+
+// Percentile (in 1/1000) of the total latency
+static u32 lat_percentile(u32 pm) {
+    u32 target = (u32) (((u64) lat_count * pm + 999) / 1000);
+    u32 n = 0;
+    for (int b = 0; b < LAT_NBUCKET; b++) {
+        n += lat_hist[b];
+        if (n >= target) {
+            u32 top = lat_bucket_top(b);
+            return (top < lat_max) ? top : lat_max;
+        }
+    }
+    return lat_max;
+}
+
+// Format a time in us as ms with two decimals
+static char *lat_ms(char *buf, u32 us) {
+    us = (us + 5) / 10;
+    sprintf(buf, "%u.%02u", us/100, us%100);
+    return buf;
+}
+
+// Report the statistics
+void latency_report(int n, char *buf) {
+    char a[16], b[16], c[16];
+    if (n == 2) {
+        sprintf(buf, "usb %d HID itf, tasks avg %u us max %s ms", keyb_hid_count(),
+            (usb_count == 0) ? 0 : (u32) (usb_sum / usb_count), lat_ms(a, usb_max));
+    } else if (lat_count == 0) {
+        strcpy(buf, (n == 0) ? "key->wire: no keys sent" : "");
+    } else if (n == 0) {
+        sprintf(buf, "key->wire %u keys  p50 %s p99 %s max %s ms", lat_count,
+            lat_ms(a, lat_percentile(500)), lat_ms(b, lat_percentile(990)), lat_ms(c, lat_max));
+    } else {
+        sprintf(buf, "avg usb->loop %s loop->uart %s ms  (Z: reset)",
+            lat_ms(a, (u32) (lat_sum_key / lat_count)), lat_ms(b, (u32) (lat_sum_wire / lat_count)));
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Key to wire latency measurement
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+// Times are in microseconds (time_us_32())
+//   t_report: HID report received (or auto repeat alarm)
+//   t_key:    key taken from the keyboard buffer by the main loop
+//   t_wire:   last byte of the key written to the UART
+extern void latency_record(u32 t_report, u32 t_key, u32 t_wire);
+extern void latency_reset(void);
+
+// Time of the USB tasks in a pass of the main loop
+extern void latency_usb_poll(u32 us);
+
+// Report lines for the config screen
+//   n = 0: number of keys and p50/p99/max of the total latency
+//   n = 1: average time in each stage
+//   n = 2: HID interfaces and average/max time of the USB tasks
+extern void latency_report(int n, char *buf);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Keyboard layouts
+ *
+ * All the layouts are in the firmware, the config screen selects one.
+ * The full tables in keycode_to_ascii.h are only used at compile time:
+ * each layout keeps only the keys that change between layouts (letters,
+ * digits and punctuation, with shift and AltGr), the other keys (function,
+ * cursor and keypad) come from a table shared by all layouts.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "include.h"
+
+#include "keycode_to_ascii.h"
+
+const char *layout_name[NLAYOUT+1] = { "US", "UK", "DE", "BR", NULL };
+
+// Keys in the layout tables
+//   rows 0 to 52: usages 0x04 (A) to 0x38 (/)
+//   row 53: usage 0x64 (non-US \ key)
+//   row 54: usage 0x87 (ABNT2 / key)
+#define LAYOUT_FIRST    0x04
+#define LAYOUT_LAST     0x38
+#define LAYOUT_ROWS     (LAYOUT_LAST - LAYOUT_FIRST + 3)
+
+// Keys in the shared table: usages 0x39 (caps lock) to 0x63 (keypad .)
+#define COMMON_FIRST    0x39
+#define COMMON_LAST     0x63
+
+typedef struct {
+    u8 key[LAYOUT_ROWS][3];     // without shift, with shift, with AltGr
+    bool altgr;                 // right Alt is AltGr
+} LAYOUT_TABLE;
+
+// Row of a key in the layout tables, -1 if not there
+static constexpr int layout_row(int usage) {
+    return ((usage >= LAYOUT_FIRST) && (usage <= LAYOUT_LAST)) ? usage - LAYOUT_FIRST :
+           (usage == 0x64) ? LAYOUT_ROWS - 2 :
+           (usage == 0x87) ? LAYOUT_ROWS - 1 : -1;
+}
+
+// Build a compact table from a full table
+template <size_t N>
+static constexpr LAYOUT_TABLE layout_compact(const u8 (&full)[N][3], bool altgr) {
+    LAYOUT_TABLE t = {};
+    for (int usage = 0; usage < (int) N; usage++) {
+        int row = layout_row(usage);
+        if (row >= 0) {
+            for (int i = 0; i < 3; i++) {
+                t.key[row][i] = full[usage][i];
+            }
+        }
+    }
+    t.altgr = altgr;
+    return t;
+}
+
+static constexpr LAYOUT_TABLE layout_us() {
+    const u8 full[][3] = { HID_KEYCODE_TO_ASCII_US };
+    return layout_compact(full, false);
+}
+static constexpr LAYOUT_TABLE layout_uk() {
+    const u8 full[][3] = { HID_KEYCODE_TO_ASCII_UK };
+    return layout_compact(full, false);
+}
+static constexpr LAYOUT_TABLE layout_de() {
+    const u8 full[][3] = { HID_KEYCODE_TO_ASCII_DE };
+    return layout_compact(full, true);
+}
+static constexpr LAYOUT_TABLE layout_br() {
+    const u8 full[][3] = { HID_KEYCODE_TO_ASCII_BR };
+    return layout_compact(full, true);
+}
+
+static constexpr LAYOUT_TABLE layout_table[NLAYOUT] = {
+    layout_us(), layout_uk(), layout_de(), layout_br()
+};
+
+// Shared keys (taken from the US layout)
+struct COMMON_TABLE {
+    u8 key[COMMON_LAST - COMMON_FIRST + 1][2];
+    constexpr COMMON_TABLE() : key() {
+        const u8 full[][3] = { HID_KEYCODE_TO_ASCII_US };
+        for (int usage = COMMON_FIRST; usage <= COMMON_LAST; usage++) {
+            key[usage - COMMON_FIRST][0] = full[usage][0];
+            key[usage - COMMON_FIRST][1] = full[usage][1];
+        }
+    }
+};
+static constexpr COMMON_TABLE common_table;
+
+// Dead key combinations (Latin-1)
+typedef struct {
+    u8 dead;
+    u8 spacing;         // accent alone (dead key followed by space)
+    char base[13];
+    u8 result[12];
+} COMPOSE;
+
+static const COMPOSE compose_table[] = {
+    { DEAD_ACUTE, 0xB4, "aeiouyAEIOUY", { 0xE1, 0xE9, 0xED, 0xF3, 0xFA, 0xFD, 0xC1, 0xC9, 0xCD, 0xD3, 0xDA, 0xDD } },
+    { DEAD_GRAVE, '`',  "aeiouAEIOU",   { 0xE0, 0xE8, 0xEC, 0xF2, 0xF9, 0xC0, 0xC8, 0xCC, 0xD2, 0xD9 } },
+    { DEAD_CIRC,  '^',  "aeiouAEIOU",   { 0xE2, 0xEA, 0xEE, 0xF4, 0xFB, 0xC2, 0xCA, 0xCE, 0xD4, 0xDB } },
+    { DEAD_TILDE, '~',  "aonAON",       { 0xE3, 0xF5, 0xF1, 0xC3, 0xD5, 0xD1 } },
+    { DEAD_DIAER, 0xA8, "aeiouyAEIOU",  { 0xE4, 0xEB, 0xEF, 0xF6, 0xFC, 0xFF, 0xC4, 0xCB, 0xCF, 0xD6, 0xDC } }
+};
+
+// Current layout, the default is selected in CMakeLists.txt
+#if defined(LOCALISE_DE)
+#define LAYOUT_DEFAULT  LAYOUT_DE
+#elif defined(LOCALISE_UK)
+#define LAYOUT_DEFAULT  LAYOUT_UK
+#elif defined(LOCALISE_BR)
+#define LAYOUT_DEFAULT  LAYOUT_BR
+#else
+#define LAYOUT_DEFAULT  LAYOUT_US
+#endif
+static LAYOUT layout_sel = LAYOUT_DEFAULT;
+static const LAYOUT_TABLE *layout = &layout_table[LAYOUT_DEFAULT];
+
+// Pending dead key
+static const COMPOSE *dead_key;
+
+// Select a layout
+void layout_select(LAYOUT n) {
+    layout_sel = n;
+    layout = &layout_table[n];
+    dead_key = NULL;
+}
+
+// Get the selected layout
+LAYOUT layout_get() {
+    return layout_sel;
+}
+
+// Test if right Alt is AltGr
+bool layout_has_altgr() {
+    return layout->altgr;
+}
+
+// Code for a Latin-1 character
+static inline u8 latin1_code(u8 c) {
+    return (c < 0x80) ? c : L1(c);
+}
+
+// Test if a code is a letter (affected by caps lock)
+static inline bool is_letter(u8 code) {
+    return ((code >= 'a') && (code <= 'z')) ||
+           ((code >= L1(0xE0)) && (code <= L1(0xFE)) && (code != L1(0xF7)));
+}
+
+// Translate a key
+uint8_t layout_key(uint8_t usage, bool shift, bool altgr, bool capslock) {
+    int row = layout_row(usage);
+    if (row >= 0) {
+        if (altgr) {
+            return layout->key[row][2];
+        }
+        if (capslock && is_letter(layout->key[row][0])) {
+            shift = !shift;
+        }
+        return layout->key[row][shift ? 1 : 0];
+    }
+    if ((usage >= COMMON_FIRST) && (usage <= COMMON_LAST)) {
+        // shift is passed as a modifier for keys without a shifted code
+        u8 code = common_table.key[usage - COMMON_FIRST][shift ? 1 : 0];
+        return (code != 0) ? code : common_table.key[usage - COMMON_FIRST][0];
+    }
+    return 0;
+}
+
+// Handle dead keys
+int layout_compose(uint8_t code, uint8_t *out) {
+    if ((code >= DEAD_ACUTE) && (code <= DEAD_DIAER)) {
+        // dead key, wait for the next one
+        dead_key = &compose_table[code - DEAD_ACUTE];
+        return 0;
+    }
+    if (dead_key == NULL) {
+        out[0] = code;
+        return 1;
+    }
+    const COMPOSE *dk = dead_key;
+    dead_key = NULL;
+    if (code == ' ') {
+        out[0] = latin1_code(dk->spacing);
+        return 1;
+    }
+    for (int i = 0; dk->base[i] != 0; i++) {
+        if (dk->base[i] == code) {
+            out[0] = latin1_code(dk->result[i]);
+            return 1;
+        }
+    }
+    // no combination, the accent and the key
+    out[0] = latin1_code(dk->spacing);
+    out[1] = code;
+    return (code != 0) ? 2 : 1;
+}
+
+// Flash used by the layout tables
+uint layout_flash_size() {
+    return sizeof(layout_table) + sizeof(common_table) + sizeof(compose_table) + sizeof(layout_name);
+}
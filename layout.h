@@ -0,0 +1,47 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Keyboard layouts
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _LAYOUT_H
+#define _LAYOUT_H
+
+// Available layouts
+typedef enum { LAYOUT_US = 0, LAYOUT_UK, LAYOUT_DE, LAYOUT_BR, NLAYOUT } LAYOUT;
+extern const char *layout_name[NLAYOUT+1];
+
+// Codes used in the layout tables (keycode_to_ascii.h)
+#define L1(c)       ((c) - 0xA0 + KEY_LATIN1)   // Latin-1 character (0xA0 to 0xFF)
+#define DEAD_ACUTE  0x01                        // dead keys, combined with the next key
+#define DEAD_GRAVE  0x02
+#define DEAD_CIRC   0x03
+#define DEAD_TILDE  0x04
+#define DEAD_DIAER  0x05
+
+// Layout selection
+extern void layout_select(LAYOUT layout);
+extern LAYOUT layout_get(void);
+extern bool layout_has_altgr(void);
+
+// Translate a key (HID usage) to a code
+extern uint8_t layout_key(uint8_t usage, bool shift, bool altgr, bool capslock);
+
+// Handle dead keys, returns the number of codes to store (0 to 2)
+extern int layout_compose(uint8_t code, uint8_t *out);
+
+// Flash used by the layout tables
+extern uint layout_flash_size(void);
+
+#endif
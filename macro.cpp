@@ -0,0 +1,177 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Keyboard macros
+ *
+ * ALT M starts recording, the next function key selects the macro. The keys
+ * typed are sent as usual and recorded until ALT M is pressed again, then
+ * the macros are saved in the last sector of the flash. ALT and a function
+ * key replays the macro.
+ *
+ * The keys are recorded as key events, so the replay follows the current
+ * cursor and keypad modes. The replay is done by macro_task(), a key at a
+ * time while the TX buffer has room, so the main loop keeps handling the
+ * received data and the keyboard.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "include.h"
+
+// Macro table, a copy of the flash sector
+#define MACRO_MAGIC         0x4F52434D      // "MCRO"
+#define MACRO_FLASH_OFFSET  (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+typedef struct {
+    u32 magic;
+    u16 len[MACRO_COUNT];
+    KEY_EVENT keys[MACRO_COUNT][MACRO_KEYS];
+} MACRO_TABLE;
+
+static union {
+    MACRO_TABLE t;
+    u8 sector[FLASH_SECTOR_SIZE];
+} macros __attribute__ ((aligned(4)));
+
+static_assert(sizeof(MACRO_TABLE) <= FLASH_SECTOR_SIZE, "macros don't fit in a flash sector");
+
+// Recording
+typedef enum { REC_OFF, REC_SELECT, REC_ON } REC_STATE;
+static REC_STATE rec_state = REC_OFF;
+static int rec_macro;
+static char rec_status[8];
+
+// Replay
+// Keys are sent while the TX buffer has more than PLAY_ROOM free
+#define PLAY_ROOM   16
+static int play_macro = -1;
+static int play_pos;
+
+// Macro for a function key, -1 for other keys
+static int macro_index(u8 code) {
+    if ((code >= KEY_F1) && (code <= KEY_F10)) {
+        return code - KEY_F1;
+    }
+    if ((code == KEY_F11) || (code == KEY_F12)) {
+        return 10 + code - KEY_F11;
+    }
+    return -1;
+}
+
+// Keys handled locally are not recorded
+static bool local_key(u8 code) {
+    return (code >= KEY_ALT_C) && ((code < KEY_INS) || (code > KEY_F12));
+}
+
+// Load the macros
+void macro_init() {
+    const MACRO_TABLE *flash = (const MACRO_TABLE *) (XIP_BASE + MACRO_FLASH_OFFSET);
+    if (flash->magic == MACRO_MAGIC) {
+        memcpy(&macros.t, flash, sizeof(MACRO_TABLE));
+    } else {
+        memset(&macros, 0, sizeof(macros));
+        macros.t.magic = MACRO_MAGIC;
+    }
+}
+
+// End the recording and save the macros
+static void macro_save() {
+    rec_state = REC_OFF;
+    update_sl_mode();
+    FlashWrite(MACRO_FLASH_OFFSET, macros.sector, sizeof(macros.sector));
+}
+
+// Handle a key
+bool macro_key(KEY_EVENT ev) {
+    int m = macro_index(ev.code);
+    switch (rec_state) {
+        case REC_SELECT:
+            // function key for the macro, other keys cancel
+            if (m >= 0) {
+                rec_macro = m;
+                macros.t.len[m] = 0;
+                rec_state = REC_ON;
+                sprintf(rec_status, "REC F%-2d", m+1);
+            } else {
+                rec_state = REC_OFF;
+            }
+            update_sl_mode();
+            return true;
+
+        case REC_ON:
+            if (ev.code == KEY_ALT_M) {
+                macro_save();
+                return true;
+            }
+            if ((m >= 0) && (ev.mods & KMOD_ALT) && (macros.t.len[m] != 0)) {
+                return true;    // no replay while recording
+            }
+            if (!local_key(ev.code)) {
+                int n = macros.t.len[rec_macro];
+                macros.t.keys[rec_macro][n++] = ev;
+                macros.t.len[rec_macro] = n;
+                if (n == MACRO_KEYS) {
+                    // full, this key is the last one
+                    beep();
+                    macro_save();
+                }
+            }
+            return false;
+
+        default:
+            if (ev.code == KEY_ALT_M) {
+                rec_state = REC_SELECT;
+                strcpy(rec_status, "REC ?  ");
+                update_sl_mode();
+                return true;
+            }
+            if ((m >= 0) && (ev.mods & KMOD_ALT) && (macros.t.len[m] != 0)) {
+                // an empty macro leaves the key to the host (CSI 1;3 P and so on)
+                if (play_macro < 0) {
+                    play_macro = m;
+                    play_pos = 0;
+                }
+                return true;
+            }
+            return false;
+    }
+}
+
+// Replay the next keys
+void macro_task() {
+    if (play_macro < 0) {
+        return;
+    }
+    const KEY_EVENT *keys = macros.t.keys[play_macro];
+    int len = macros.t.len[play_macro];
+    switch (term_mode) {
+        case ONLINE:
+            while ((play_pos < len) && (tx_room() > PLAY_ROOM)) {
+                send_key(keys[play_pos++]);
+            }
+            break;
+        case LOCAL:
+            // one key per pass, as if typed
+            receive_key(keys[play_pos++]);
+            break;
+        default:
+            play_pos = len;
+            break;
+    }
+    if (play_pos >= len) {
+        play_macro = -1;
+    }
+}
+
+const char *macro_status() {
+    return (rec_state == REC_OFF) ? NULL : rec_status;
+}
@@ -0,0 +1,38 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Keyboard macros
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _MACRO_H
+#define _MACRO_H
+
+// One macro for each function key, replayed with ALT F1 to ALT F12
+#define MACRO_COUNT 12
+#define MACRO_KEYS  160     // keys in a macro
+
+// Load the macros saved in the flash
+extern void macro_init(void);
+
+// Handle a key (recording and replay)
+// Returns true if the key was used by the macros
+extern bool macro_key(KEY_EVENT ev);
+
+// Replay, called from the main loop
+extern void macro_task(void);
+
+// Text for the mode in the status line while recording, NULL otherwise
+extern const char *macro_status(void);
+
+#endif
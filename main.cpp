@@ -22,10 +22,90 @@
 #include "include.h"
 
 // text screen (character code + backgound coler + foreground color, format GF_ATEXT)
-u8 TextBuf[TEXTSIZE] __attribute__ ((aligned(4)));
+u8 TextBuf[TEXTBUFSIZE] __attribute__ ((aligned(4)));
+
+// alternate screen, used by full screen applications
+u8 AltBuf[TEXTBUFSIZE] __attribute__ ((aligned(4)));
+
+// copy of font, followed by the bold version
+static u8 Font_Copy[2*FONTMAX] __attribute__ ((aligned(4)));
+
+// text geometries
+typedef struct {
+	const sVideo *video;	// video timings
+	u16 width;		// screen width in pixels
+	u16 height;		// screen height
+	u32 freq;		// required minimal system frequency in kHz
+	const u8 *font;		// font
+	u16 fontsize;		// font size in bytes
+	u8 fonth;		// font height
+	bool attrib;		// attributes drawn by the renderer
+} GEO_DEF;
+
+// XGA is stretched to 1056 pixels to get 132 columns.
+// The text is rendered by RenderXText: 39 cycles per character without
+// attributes and 50 with any attributes, plus about 170 cycles of setup;
+// without the attribute plane 32 cycles per character. The frequencies are
+// whole clocks per pixel (what VgaCfg can use) below the 270 MHz limit,
+// chosen so that the slowest line takes at most about 80% of the scanline,
+// leaving at least 1100 cycles for VgaLine() and the mouse pointer layer:
+//   80 columns at 7 clocks per pixel (176 MHz, 5600 cycles per scanline),
+//     4170 cycles with every character attributed
+//   100 columns at 6 clocks per pixel (240 MHz, 6336 cycles per scanline),
+//     5170 cycles with every character attributed
+//   132 columns at 4 clocks per pixel (268 MHz, 5542 cycles per scanline),
+//     4400 cycles without the attribute plane (6770 with it would not fit),
+//     so the attributes are not drawn; the selection swaps the colors of
+//     the cells instead (see mark_selected)
+static const GEO_DEF geo_def[NGEOMETRY] = {
+	{ &VideoVGA,   640, 480, 176000, FontBold8x16, sizeof(FontBold8x16), 16, true },
+	{ &VideoSVGA,  800, 600, 240000, FontBold8x16, sizeof(FontBold8x16), 16, true },
+	{ &VideoXGA,  1056, 768, 268000, FontBold8x16, sizeof(FontBold8x16), 16, false },
+	{ &VideoVGA,   640, 480, 176000, FontBold8x14, sizeof(FontBold8x14), 14, true },
+	{ &VideoSVGA,  800, 600, 240000, FontBold8x14, sizeof(FontBold8x14), 14, true },
+	{ &VideoXGA,  1056, 768, 268000, FontBold8x14, sizeof(FontBold8x14), 14, false },
+	{ &VideoVGA,   640, 480, 176000, FontBold8x8,  sizeof(FontBold8x8),   8, true },
+	{ &VideoSVGA,  800, 600, 240000, FontBold8x8,  sizeof(FontBold8x8),   8, true },
+	{ &VideoXGA,  1056, 768, 268000, FontBold8x8,  sizeof(FontBold8x8),   8, false }
+};
+
+const char *geometry_name[NGEOMETRY+1] = {
+	"80x30 ", "100x37", "132x48", "80x34 ", "100x42", "132x54",
+	"80x60 ", "100x75", "132x96", NULL
+};
 
-// copy of font
-static u8 Font_Copy[sizeof(FONT)] __attribute__ ((aligned(4)));
+// current geometry and text size
+GEOMETRY geometry = GEO_80x30;
+int TextW, TextH;
+
+// text segment
+static sSegm *TextSegm;
+
+// Power saving video profile
+// Runs at the lowest clock found by VideoCalibrate() for the geometry
+// and lowers the core voltage when the clock allows it
+#define CALIB_MARGIN	75	// max. time to prepare a scanline, in % of the scanline time
+#define CALIB_FRAMES	30	// frames observed for each clock
+#define LOWVOLT_FREQ	100000	// max. frequency (kHz) for running at 1.05V
+bool power_save = false;
+
+// Calibrated clock for each geometry in kHz (0 = not calibrated)
+// Kept in a flash page of the sector before the keyboard macros
+#define CALIB_MAGIC	0x424C4143	// "CALB"
+#define CALIB_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - 2*FLASH_SECTOR_SIZE)
+typedef struct {
+	u32 magic;
+	u32 khz[NGEOMETRY];
+} CALIB_TABLE;
+static union {
+	CALIB_TABLE t;
+	u8 page[FLASH_PAGE_SIZE];
+} calib __attribute__ ((aligned(4)));
+static enum vreg_voltage cur_voltage = VREG_VOLTAGE_DEFAULT;
+
+// Mouse pointer layer, only in the videomode while a mouse is connected
+// (the layer needs at least 4 clocks per pixel)
+static bool mouse_layer = false;
 
 // color pallet
 u8 rpterm_pallet[NCOLOR_PAL] =
@@ -60,35 +140,297 @@ static uint32_t led_end;
 static const uint32_t led_fast = 200;
 static const uint32_t led_slow = 500;
 
-// initialize video
-static void VideoInit()
+// setup videomode for the current geometry
+//   freq: required system clock in kHz
+static void VideoSetup(u32 freq)
 {
-	// copy font to RAM buffer
-	memcpy(Font_Copy, FONT, sizeof(FONT));
+	const GEO_DEF *geo = &geo_def[geometry];
 
-	// run VGA core
-	multicore_launch_core1(VgaCore);
+	// copy font to RAM buffer and make the bold version (one pixel wider)
+	memcpy(Font_Copy, geo->font, geo->fontsize);
+	for (int i = 0; i < geo->fontsize; i++) {
+		Font_Copy[geo->fontsize+i] = Font_Copy[i] | (Font_Copy[i] >> 1);
+	}
 
 	// setup videomode
 	VgaCfgDef(&Cfg); // get default configuration
-	Cfg.video = &VideoVGA; // video timings
-	Cfg.width = WIDTH; // screen width
-	Cfg.height = HEIGHT; // screen height
+	Cfg.video = geo->video; // video timings
+	Cfg.width = geo->width; // screen width
+	Cfg.height = geo->height; // screen height
+	Cfg.wfull = geo->width; // stretch to full visible width
+	Cfg.freq = freq; // required system frequency
+	if (mouse_layer) {
+		Cfg.mode[MOUSE_LAYER] = MOUSE_LAYERMODE; // mouse pointer
+	}
 	VgaCfg(&Cfg, &Vmode); // calculate videomode setup
 
+	// text size
+	TextW = geo->width/FONTW;
+	TextH = geo->height/geo->fonth;
+
 	// initialize base layer 0
+	// The text strip covers whole lines only, the lines left by the font
+	// height are split above (an empty strip) and below (no strip) in black
+	int texth = TextH*geo->fonth;
+	int top = (geo->height - texth)/2;
 	ScreenClear(pScreen);
-	sStrip* t = ScreenAddStrip(pScreen, HEIGHT);
-	sSegm* g = ScreenAddSegm(t, WIDTH);
-	ScreenSegmCText(g, TextBuf, Font_Copy, FONTH, TEXTWB);
-	
-	// initialize system clock
+	if (top > 0) {
+		ScreenAddStrip(pScreen, top);
+	}
+	sStrip* t = ScreenAddStrip(pScreen, texth);
+	sSegm* g = ScreenAddSegm(t, geo->width);
+	ScreenSegmXText(g, ScrBuf, Font_Copy, geo->fonth, TEXTWB, geo->attrib ? MAXTEXTSIZE : 0, TEXTW);
+	TextSegm = g;
+
+	// overlapped layer for the mouse pointer
+	if (mouse_layer) {
+		mouse_video_setup(&Vmode, geo->width, geo->height, top, geo->fonth);
+	}
+
+	// highest clocks need a little more voltage, low clocks can run with less
+	enum vreg_voltage volt = VREG_VOLTAGE_DEFAULT;
+	if (Vmode.freq > 250000) {
+		volt = VREG_VOLTAGE_1_20;
+	} else if (power_save && (Vmode.freq <= LOWVOLT_FREQ)) {
+		volt = VREG_VOLTAGE_1_05;
+	}
+
+	// initialize system clock, voltage is raised before and lowered after the change
+	if (volt > cur_voltage) {
+		vreg_set_voltage(volt);
+		sleep_ms(1);
+	}
 	set_sys_clock_pll(Vmode.vco*1000, Vmode.pd1, Vmode.pd2);
+	if (volt < cur_voltage) {
+		vreg_set_voltage(volt);
+	}
+	cur_voltage = volt;
+}
+
+// required clock for the current geometry
+static u32 VideoFreq()
+{
+	if (power_save && (calib.t.khz[geometry] != 0)) {
+		return calib.t.khz[geometry];
+	}
+	return geo_def[geometry].freq;
+}
+
+// restart the video driver with a new clock
+static void VideoRestart(u32 freq)
+{
+	// stop the video driver
+	VgaInitReq(NULL);
+
+	// setup and restart the video
+	VideoSetup(freq);
+	VgaInitReq(&Vmode);
+
+	// peripheral clock follows the system clock, reprogram the UART
+	serial_config(config_getbaudrate(), config_getfmt());
+}
+
+// initialize video
+static void VideoInit()
+{
+	// calibrated clocks saved in the flash
+	const CALIB_TABLE *flash = (const CALIB_TABLE *) (XIP_BASE + CALIB_FLASH_OFFSET);
+	if (flash->magic == CALIB_MAGIC) {
+		calib.t = *flash;
+	} else {
+		calib.t.magic = CALIB_MAGIC;
+	}
+
+	// run VGA core
+	multicore_launch_core1(VgaCore);
+
+	// setup videomode
+	VideoSetup(VideoFreq());
 
 	// initialize videomode
 	VgaInitReq(&Vmode);
 }
 
+// Change the text geometry
+// The caller is responsible for redrawing the screen
+void VideoSetGeometry(GEOMETRY geo)
+{
+	if (geo == geometry) {
+		return;
+	}
+
+	scrollback_live();
+	select_clear();		// the marks may have swapped colors
+	geometry = geo;
+	VideoRestart(VideoFreq());
+
+	// update text grid
+	video_resize();
+}
+
+// Turn the power saving profile on or off
+void VideoPowerSave(bool on)
+{
+	if (on != power_save) {
+		power_save = on;
+		VideoRestart(VideoFreq());
+	}
+}
+
+// Add or remove the mouse pointer layer
+void VideoMouseLayer(bool on)
+{
+	if (on != mouse_layer) {
+		mouse_layer = on;
+		VideoRestart(VideoFreq());
+	}
+}
+
+// Core 1 waits in RAM while the flash is written
+static volatile bool flash_busy, core1_parked;
+
+static void __not_in_flash_func(Core1Park)()
+{
+	uint32_t irq = save_and_disable_interrupts();
+	core1_parked = true;
+	while (flash_busy) { __dmb(); }
+	restore_interrupts(irq);
+}
+
+// Erase a sector of the flash and write size bytes (a multiple of FLASH_PAGE_SIZE)
+// The flash can't be read while it is written, so the video is stopped
+// (the screen blanks for a moment) and core 1 is parked in RAM.
+// The UART interrupt can't run during the erase (tens to hundreds of ms),
+// the data received then is lost; the write waits for a pause in the data
+// from the host (FLASH_RX_IDLE), for up to FLASH_RX_WAIT.
+#define FLASH_RX_IDLE	20	// ms without data received
+#define FLASH_RX_WAIT	100	// ms
+void FlashWrite(u32 offset, const u8 *data, u32 size)
+{
+	serial_rx_pause(FLASH_RX_IDLE, FLASH_RX_WAIT);
+	VgaInitReq(NULL);
+	flash_busy = true;
+	core1_parked = false;
+	Core1Exec(Core1Park);
+	while (!core1_parked) { __dmb(); }
+
+	uint32_t irq = save_and_disable_interrupts();
+	flash_range_erase(offset, FLASH_SECTOR_SIZE);
+	flash_range_program(offset, data, size);
+	restore_interrupts(irq);
+
+	flash_busy = false;
+	Core1Wait();
+	VgaInitReq(&Vmode);
+}
+
+// Find the lowest clock that renders the current geometry reliably
+// Steps down one clock per pixel at a time (the clocks VgaCfg can use),
+// watching the scan-out headroom; the margin is in CALIB_MARGIN.
+// The result is saved in the flash.
+// Returns the calibrated clock in kHz
+u32 VideoCalibrate()
+{
+	const GEO_DEF *geo = &geo_def[geometry];
+	float hfull = geo->video->hfull;
+	u32 freq = geo->freq;
+	u32 best = 0;
+	int clocks = 0;		// clocks per pixel of the last clock tried
+	sVgaStat stat;
+
+	while (true) {
+		VideoRestart(freq);
+
+		// VgaCfg can round back to a clock already tried
+		int cpp = Vmode.cpp * Vmode.div;
+		if ((clocks != 0) && (cpp >= clocks)) {
+			break;
+		}
+		clocks = cpp;
+
+		// watch a few frames
+		bool ok = true;
+		sleep_ms(50);	// skip the first frames
+		for (int i = 0; ok && (i < CALIB_FRAMES); i++) {
+			sleep_ms(20);
+			VgaStatGet(&stat);
+			ok = (stat.miss == 0) && (stat.timeout == 0) &&
+				(stat.max*100 <= stat.budget*CALIB_MARGIN);
+		}
+		if (!ok) {
+			break;
+		}
+		best = Vmode.freq;
+
+		// next lower clock: one system clock less per pixel
+		if (clocks <= 2) {
+			break;
+		}
+		freq = (u32) ((clocks-1)*geo->width*1000/hfull);
+	}
+
+	// keep the result, go back to the selected profile and save it
+	bool changed = (best != 0) && (best != calib.t.khz[geometry]);
+	if (changed) {
+		calib.t.khz[geometry] = best;
+	}
+	VideoRestart(VideoFreq());
+	if (changed) {
+		FlashWrite(CALIB_FLASH_OFFSET, calib.page, sizeof(calib.page));
+	}
+	return best;
+}
+
+// Select the buffer shown in the screen (TextBuf, AltBuf or a scrollback window)
+void VideoSetText(const u8 *buf)
+{
+	TextSegm->data = buf;
+}
+
+// Attributes are drawn by the renderer (not at 132 columns)
+bool VideoAttributes()
+{
+	return geo_def[geometry].attrib;
+}
+
+// Returns the geometry with the same font and 80 or 132 columns
+GEOMETRY geometry_columns(GEOMETRY geo, bool wide)
+{
+	int font = geo / GEO_RES;
+	return (GEOMETRY) (font*GEO_RES + (wide ? GEO_132x48 : GEO_80x30));
+}
+
+// Report system clock and scan-out headroom
+//   n = 0: clock and scanline time
+//   n = 1: VgaLine() min/avg/max of last frame
+//   n = 2: histogram of VgaLine() times (by 1/8 of scanline time), deadline misses and timeouts
+void VideoReport(int n, char *buf)
+{
+	sVgaStat stat;
+	VgaStatGet(&stat);
+	u32 khz = Vmode.freq;
+	u32 budget = (stat.budget == 0) ? 1 : stat.budget;
+	switch (n) {
+		case 0: {
+				u32 line = budget * 10000 / khz;	// scanline time in 0.1us
+				sprintf(buf, "clock %3u MHz  scanline %2u.%u us = %u cycles",
+					khz/1000, line/10, line%10, stat.budget);
+			}
+			break;
+		case 1:
+			sprintf(buf, "render min %u%% avg %u%% max %u%% (%u cycles)",
+				stat.min*100/budget, stat.avg*100/budget, stat.max*100/budget, stat.max);
+			break;
+		case 2:
+			buf += sprintf(buf, "hist");
+			for (int i = 0; i < VGASTAT_HIST; i++) {
+				buf += sprintf(buf, " %u", stat.hist[i]);
+			}
+			sprintf(buf, "  miss %u  timeout %u", stat.miss, stat.timeout);
+			break;
+	}
+}
+
 // Init beep pin
 static void beep_init() {
 	#ifdef BUZZER_PIN
@@ -161,9 +503,148 @@ static void led_task() {
 	#endif
 }
 
+// Bus contention measurement
+// BUSCTRL counters 0..3 count the contested accesses to the striped SRAM banks 0..3
+static const bus_ctrl_perf_counter bus_perf_sel[4] = {
+	arbiter_sram0_perf_event_access_contested, arbiter_sram1_perf_event_access_contested,
+	arbiter_sram2_perf_event_access_contested, arbiter_sram3_perf_event_access_contested
+};
+static u32 bus_stalls;		// contested accesses in the last second
+static uint32_t bus_end;
+
+// Init bus performance counters
+static void bus_perf_init() {
+	for (int i = 0; i < 4; i++) {
+		bus_ctrl_hw->counter[i].sel = bus_perf_sel[i];
+		bus_ctrl_hw->counter[i].value = 0;
+	}
+	bus_end = board_millis() + 1000;
+}
+
+// Collect bus performance counters every second
+static void bus_perf_task() {
+	uint32_t now = board_millis();
+	if (now >= bus_end) {
+		u32 total = 0;
+		for (int i = 0; i < 4; i++) {
+			total += bus_ctrl_hw->counter[i].value;	// counters saturate at 2^24-1
+			bus_ctrl_hw->counter[i].value = 0;		// any write clears the counter
+		}
+		bus_stalls = total;
+		bus_end = now + 1000;
+	}
+}
+
+// Report bus contention
+void BusReport(char *buf) {
+	sprintf(buf, "SRAM0-3 contested %u/s (render data in %s)", bus_stalls,
+		RENDER_SCRATCH ? "scratch X" : "main SRAM");
+}
+
+// Barcode scanner bursts
+// The keys of a burst are encoded, with the prefix and suffix, in one buffer
+// that is written to the TX buffer at once (in pieces if it does not fit).
+// Keys typed and macros meanwhile wait, also while a long scan is taken in
+// several pieces, so they are not mixed with the scan.
+#define BURST_BUF	256
+static u8 burst_buf[BURST_BUF];
+static int burst_len, burst_pos;
+static bool burst_open;		// prefix sent, suffix pending
+
+static bool burst_sending() {
+	return burst_pos < burst_len;
+}
+
+// Add text to the burst buffer
+static void burst_add(const char *str) {
+	while (*str) {
+		burst_buf[burst_len++] = *str++;
+	}
+}
+
+static void burst_task() {
+	if (burst_sending()) {
+		int n = burst_len - burst_pos;
+		int room = tx_room();
+		put_tx_buf(burst_buf + burst_pos, (n < room) ? n : room);
+		burst_pos += (n < room) ? n : room;
+		return;
+	}
+
+	// keys typed before the scan go first, the ones typed after the
+	// prefix wait for the suffix
+	if ((has_kbd() && !burst_open) || !has_kbd_burst()) {
+		return;
+	}
+	burst_len = burst_pos = 0;
+	if (!burst_open) {
+		burst_add(config_getscanprefix());
+		burst_open = true;
+	}
+	KEY_EVENT ev;
+	int r;
+	while ((burst_len + 16 <= BURST_BUF) && ((r = get_kbd_burst(&ev)) != 0)) {
+		if (r < 0) {
+			burst_add(config_getscansuffix());
+			burst_open = false;
+			break;
+		}
+		burst_len += encode_key(ev, burst_buf + burst_len);
+	}
+
+	// the scan is typed in the local mode and dropped in the config screen
+	if (term_mode == LOCAL) {
+		for (int i = 0; i < burst_len; i++) {
+			put_rx(burst_buf[i]);
+		}
+		burst_len = 0;
+	} else if (term_mode == CONFIG) {
+		burst_len = 0;
+	} else if (scrollback_viewing() && !scrollback_searching()) {
+		scrollback_live();
+	}
+}
+
 // Handle keyboard input
 static void kbd_task() {
-	uint8_t key = get_kbd();
+	KEY_EVENT ev = get_kbd();
+	uint8_t key = ev.code;
+	if (term_mode != CONFIG) {
+		// scrollback history, any other key goes back to the live screen
+		if (scrollback_searching()) {
+			scrollback_search_key(key);
+			return;
+		}
+		// text selection, any other key removes it
+		if (select_keyboard_mode()) {
+			select_key(key);
+			return;
+		}
+		select_clear();
+		// keyboard macros (the keys sent are recorded)
+		if (macro_key(ev)) {
+			return;
+		}
+		if (key == KEY_ALT_S) {
+			scrollback_search();
+			return;
+		}
+		if (key == KEY_ALT_V) {
+			select_keyboard();
+			return;
+		}
+		if (key == KEY_ALT_P) {
+			paste_start();
+			return;
+		}
+		if ((key == KEY_SH_PGUP) || (key == KEY_SH_PGDN)) {
+			scrollback_page(key == KEY_SH_PGUP);
+			return;
+		}
+		if (scrollback_viewing()) {
+			scrollback_live();
+		}
+	}
 	switch (term_mode) {
 		case ONLINE:
 			switch (key) {
@@ -183,7 +664,8 @@ static void kbd_task() {
 					// TODO
 					break;
 				default:
-					send_key(key);
+					send_key(ev);
+					put_tx_mark(get_kbd_time());	// latency measurement
 					break;
 			}
 			break;
@@ -205,7 +687,7 @@ static void kbd_task() {
 					// TODO
 					break;
 				default:
-					receive_key(key);
+					receive_key(ev);
 					break;
 			}
 			break;
@@ -245,6 +727,12 @@ int main()
 	// init beep
 	beep_init();
 	beep();
+
+	// init bus contention measurement
+	bus_perf_init();
+
+	// load keyboard macros
+	macro_init();
 	
 	// main loop
 	while (true)
@@ -255,15 +743,37 @@ int main()
 			terminal_handle_rx (get_rx());
 		}
 
-		// handle usb
+		// handle usb (the time grows with the HID interfaces polled)
+		uint32_t t_usb = time_us_32();
 	    tuh_task();
 		hid_app_task();
+		latency_usb_poll(time_us_32() - t_usb);
 
-		// handle keys
-		if (has_kbd()) {
+		// a paste holds the keys, the macros and new scans, so they don't
+		// get inside it; it waits for the end of a scan already started
+		bool hold = paste_active() && !burst_open;
+
+		// handle scanner bursts and keys
+		if (burst_sending() || !hold) {
+			burst_task();
+		}
+		if (has_kbd() && !burst_sending() && !burst_open && !hold) {
 			kbd_task();
 		}
 
+		// mouse reports and pointer
+		mouse_task();
+
+		// send the paste
+		if (!burst_sending() && !burst_open) {
+			paste_task();
+		}
+
+		// replay keyboard macros
+		if (!burst_sending() && !burst_open && !hold) {
+			macro_task();
+		}
+
 		// trnasmit pending chars
 		serial_tx_task();
 
@@ -272,6 +782,9 @@ int main()
 
 		// take care of beep
 		beep_task();
+
+		// bus contention statistics
+		bus_perf_task();
 	}
 }
 
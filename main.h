@@ -8,26 +8,57 @@
 #ifndef _MAIN_H
 #define _MAIN_H
 
-#define WIDTH	640	// screen width in pixels
-#define HEIGHT	480	// screen height
+// Text geometries
+// Each geometry combines a video timing with a font; the text grid is
+// recalculated when the geometry is changed at runtime.
+typedef enum {
+    GEO_80x30 = 0,  // VGA 640x480, font 8x16
+    GEO_100x37,     // SVGA 800x600, font 8x16
+    GEO_132x48,     // XGA 1056x768, font 8x16
+    GEO_80x34,      // VGA 640x480, font 8x14
+    GEO_100x42,     // SVGA 800x600, font 8x14
+    GEO_132x54,     // XGA 1056x768, font 8x14
+    GEO_80x60,      // VGA 640x480, font 8x8
+    GEO_100x75,     // SVGA 800x600, font 8x8
+    GEO_132x96,     // XGA 1056x768, font 8x8
+    NGEOMETRY
+} GEOMETRY;
+#define GEO_RES     3   // number of resolutions for each font
 
-// This font will give 60 lines of text
-//#define FONT    FontBold8x8
-//#define FONTW	8	// font width
-//#define FONTH	8	// font height
-
-// This font will give 30 lines of text
-#define FONT    FontBold8x16
-#define FONTW	8	// font width
-#define FONTH	16	// font height
+#define FONTW	8	// font width (all fonts)
+#define FONTMAX 4096    // size of the biggest font (8x16)
 
 // Text sizes
 // Each character in screen uses three bytes in memory
-// (character + backgound coler + foreground color, format GF_ATEXT)
-#define TEXTW	(WIDTH/FONTW)   // text width (=80)
-#define TEXTH	(HEIGHT/FONTH)  // text height (=60)
-#define TEXTWB	(TEXTW*3)       // text width byte (=240)
-#define TEXTSIZE (TEXTWB*TEXTH) // text box size in bytes (=9600)
+// (character + backgound coler + foreground color, format GF_XTEXT)
+// plus an attribute byte, in a separate plane after the text
+#define MAXTEXTW    132                     // max text width
+#define MAXTEXTH    96                      // max text height
+#define MAXTEXTSIZE (MAXTEXTW*3*MAXTEXTH)   // max text box size in bytes (=38016)
+#define MAXATTRSIZE (MAXTEXTW*MAXTEXTH)     // max attributes size in bytes (=12672)
+#define TEXTBUFSIZE (MAXTEXTSIZE+MAXATTRSIZE)   // size of a screen buffer
+
+extern int TextW, TextH;                // current text size
+#define TEXTW	TextW                   // text width (80, 100 or 132)
+#define TEXTH	TextH                   // text height
+#define TEXTWB	(TEXTW*3)               // text width byte
+#define TEXTSIZE (TEXTWB*TEXTH)         // text box size in bytes
+#define ATTRBUF(buf) ((buf)+MAXTEXTSIZE) // attributes of a screen buffer (TEXTW bytes per line)
+
+// Video geometry control
+extern GEOMETRY geometry;
+extern const char *geometry_name[NGEOMETRY+1];
+extern void VideoSetGeometry(GEOMETRY geo);
+extern void VideoSetText(const u8 *buf);
+extern bool VideoAttributes(void);
+extern GEOMETRY geometry_columns(GEOMETRY geo, bool wide);
+extern void VideoReport(int n, char *buf);
+extern bool power_save;
+extern void VideoPowerSave(bool on);
+extern void VideoMouseLayer(bool on);
+extern void FlashWrite(u32 offset, const u8 *data, u32 size);   // a sector
+extern u32 VideoCalibrate(void);
+extern void BusReport(char *buf);
 
 // color pallet
 #define NCOLOR_PAL 24
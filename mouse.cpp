@@ -0,0 +1,275 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * USB mouse: pointer and xterm mouse reporting
+ *
+ * The pointer is a sprite in an overlapped layer, moving it changes only
+ * the sprite and layer coordinates (the text screen is not touched). The
+ * layer is as tall as the sprite and follows it, so only the scanlines
+ * with the pointer pay for the sprite rendering.
+ *
+ * Button changes are sent at once. Motion and wheel reports are coalesced:
+ * only the last cell is kept and a report is sent when the TX buffer is
+ * empty, a fast mouse on a slow line skips cells instead of queuing them.
+ *
+ * When the host is not tracking the mouse (or with shift pressed) the
+ * buttons are local: dragging with the left button selects lines, with
+ * the right button a rectangle, and the middle button pastes.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "include.h"
+
+// Pointer image, the hot spot is the top left pixel
+#define POINTER_W   8
+#define POINTER_H   12
+static constexpr char pointer_shape[POINTER_H][POINTER_W+1] = {
+    "#.......",
+    "##......",
+    "#o#.....",
+    "#oo#....",
+    "#ooo#...",
+    "#oooo#..",
+    "#ooooo#.",
+    "#oooooo#",
+    "#ooo####",
+    "#o#o#...",
+    "##.#o#..",
+    "#...##.."
+};
+
+struct PointerImage {
+    u8 pix[POINTER_H*POINTER_W];
+
+    constexpr PointerImage() : pix() {
+        for (int y = 0; y < POINTER_H; y++) {
+            for (int x = 0; x < POINTER_W; x++) {
+                char c = pointer_shape[y][x];
+                pix[y*POINTER_W+x] = (c == '#') ? COL_GRAY2 : (c == 'o') ? COL_WHITE : COL_BLACK;
+            }
+        }
+    }
+};
+static constexpr PointerImage pointer_img;
+
+// Pointer sprite
+static u8 pointer_x0[POINTER_H];
+static u8 pointer_w0[POINTER_H];
+static sSprite pointer;
+static sSprite *pointer_list[1] = { &pointer };
+
+// Mouse state
+static bool attached;               // mouse connected
+static bool layer_on;               // pointer layer in the videomode
+static int scr_w = 640, scr_h = 480, cell_h = 16;
+static int text_top;                // first scanline of the text
+static int ptr_x, ptr_y;            // pointer position in pixels
+static int cell_x, cell_y;          // pointer position in cells
+static u8 buttons_down;             // HID buttons
+
+// Tracking modes
+static int track_mode;              // 0 (off), 1000, 1002 or 1003
+static bool track_sgr;              // 1006: SGR encoding
+
+// Coalesced reports
+static bool motion_pending;
+static int wheel_pending;           // wheel clicks, positive is up
+#define WHEEL_MAX   8
+
+// HID buttons (left, right, middle) to xterm buttons
+static const u8 button_code[3] = { 0, 2, 1 };
+
+// Local selection
+#define SELECT_BUTTONS  3           // left (lines) and right (rectangle)
+static u8 select_button;            // button that started the selection
+static bool select_pending;         // pointer moved while selecting
+
+// Mouse events are reported to the host
+static bool reporting() {
+    return (track_mode != 0) && (term_mode == ONLINE) && !scrollback_viewing();
+}
+
+// Buttons used for local selection and paste
+static void local_buttons(u8 buttons, u8 changed, bool moved) {
+    if (select_button != 0) {
+        if (changed & select_button) {
+            select_button = 0;
+            select_pending = false;
+            select_copy();
+        } else if (moved) {
+            select_pending = true;
+        }
+    } else if ((changed & buttons & SELECT_BUTTONS) != 0) {
+        select_button = changed & buttons & SELECT_BUTTONS;
+        select_button &= -select_button;    // only one button
+        select_start(cell_x, cell_y, select_button == 2);
+    }
+    if ((changed & buttons & 4) != 0) {
+        paste_start();
+    }
+}
+
+// Send a mouse event at the pointer cell
+//  code: button (0 to 2, 3 for a release in the X10 encoding) plus 32 for motion
+//        and 64 for the wheel
+static void send_event(int code, bool release) {
+    char buf[24];
+    int n;
+    if (track_sgr) {
+        n = sprintf(buf, "\x1B[<%d;%d;%d%c", code, cell_x+1, cell_y+1, release ? 'm' : 'M');
+    } else {
+        if ((cell_x >= 223) || (cell_y >= 223)) {
+            return;     // can't be encoded
+        }
+        n = sprintf(buf, "\x1B[M%c%c%c", 32 + (release ? 3 : code), 32+cell_x+1, 32+cell_y+1);
+    }
+    put_tx_buf((const u8 *) buf, n);
+}
+
+// Move the pointer sprite
+static void pointer_move() {
+    if (layer_on) {
+        pointer.x = ptr_x;
+        LayerSetY(MOUSE_LAYER, ptr_y);
+    }
+}
+
+// Mouse connected or removed
+// The layer is added to the videomode by mouse_task()
+void mouse_attach(bool on) {
+    attached = on;
+    buttons_down = 0;
+    select_button = 0;
+    motion_pending = false;
+    wheel_pending = 0;
+}
+
+// Mouse movement and buttons
+void mouse_report(u8 buttons, s8 dx, s8 dy, s8 wheel) {
+    // move the pointer
+    ptr_x += dx;
+    ptr_y += dy;
+    ptr_x = (ptr_x < 0) ? 0 : (ptr_x >= scr_w) ? scr_w-1 : ptr_x;
+    ptr_y = (ptr_y < 0) ? 0 : (ptr_y >= scr_h) ? scr_h-1 : ptr_y;
+    pointer_move();
+
+    int x = ptr_x / FONTW;
+    int y = (ptr_y < text_top) ? 0 : (ptr_y - text_top) / cell_h;
+    if (y >= nlines) {
+        y = nlines-1;   // status line
+    }
+    bool moved = (x != cell_x) || (y != cell_y);
+    cell_x = x;
+    cell_y = y;
+    u8 changed = buttons ^ buttons_down;
+    buttons_down = buttons;
+
+    // buttons are ignored during a paste (they would be sent inside it
+    // or change the clipboard being sent)
+    if (paste_active()) {
+        return;
+    }
+    if ((term_mode != CONFIG) && ((select_button != 0) || !reporting() || keyb_shift())) {
+        local_buttons(buttons, changed, moved);
+        return;
+    }
+    if (!reporting()) {
+        return;
+    }
+
+    // button changes, the pending motion is replaced by the button position
+    for (int b = 0; b < 3; b++) {
+        if (changed & (1 << b)) {
+            send_event(button_code[b], (buttons & (1 << b)) == 0);
+            motion_pending = false;
+            moved = false;
+        }
+    }
+
+    // motion: any motion in 1003, with a button down in 1002
+    if (moved && ((track_mode == 1003) || ((track_mode == 1002) && (buttons & 7)))) {
+        motion_pending = true;
+    }
+
+    wheel_pending += wheel;
+    wheel_pending = (wheel_pending > WHEEL_MAX) ? WHEEL_MAX : (wheel_pending < -WHEEL_MAX) ? -WHEEL_MAX : wheel_pending;
+}
+
+// Pointer layer setup
+void mouse_video_setup(const sVmode *vmode, int width, int height, int top, int cellh) {
+    scr_w = width;
+    scr_h = height;
+    text_top = top;
+    cell_h = cellh;
+    ptr_x = (ptr_x >= scr_w) ? scr_w-1 : ptr_x;
+    ptr_y = (ptr_y >= scr_h) ? scr_h-1 : ptr_y;
+
+    pointer.img = (u8 *) pointer_img.pix;
+    pointer.x0 = pointer_x0;
+    pointer.w0 = pointer_w0;
+    pointer.keycol = COL_BLACK;
+    pointer.x = ptr_x;
+    pointer.y = 0;
+    pointer.w = POINTER_W;
+    pointer.h = POINTER_H;
+    pointer.wb = POINTER_W;
+    SpritePrepLines(pointer.img, pointer_x0, pointer_w0, POINTER_W, POINTER_H, POINTER_W, COL_BLACK, False);
+
+    // the layer is a band as tall as the pointer
+    LayerSpriteSetup(MOUSE_LAYER, pointer_list, 1, vmode, 0, ptr_y, width, POINTER_H);
+    LayerOn(MOUSE_LAYER);
+}
+
+// Mouse tracking modes
+void mouse_tracking(int mode, bool on) {
+    if (mode == 1006) {
+        track_sgr = on;
+    } else {
+        track_mode = on ? mode : 0;
+        motion_pending = false;
+        wheel_pending = 0;
+    }
+}
+
+// Sends coalesced reports and adds or removes the pointer layer
+void mouse_task() {
+    if (attached != layer_on) {
+        layer_on = attached;
+        VideoMouseLayer(attached);
+    }
+
+    if (select_pending) {
+        select_pending = false;
+        select_extend(cell_x, cell_y);
+    }
+
+    if (!reporting() || paste_active()) {
+        motion_pending = false;
+        wheel_pending = 0;
+        return;
+    }
+    if (!tx_empty()) {
+        return;
+    }
+    if (wheel_pending != 0) {
+        // one click at a time
+        send_event((wheel_pending > 0) ? 64 : 65, false);
+        wheel_pending += (wheel_pending > 0) ? -1 : 1;
+    } else if (motion_pending) {
+        int b;
+        for (b = 0; (b < 3) && !(buttons_down & (1 << b)); b++)
+            ;
+        send_event(32 + ((b < 3) ? button_code[b] : 3), false);
+        motion_pending = false;
+    }
+}
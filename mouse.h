@@ -0,0 +1,42 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * USB mouse: pointer and xterm mouse reporting
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _MOUSE_H
+#define _MOUSE_H
+
+// Overlapped layer with the pointer sprite
+// Black is transparent: LAYERMODE_SPRITEKEY needs 6 clocks per pixel,
+// more than the XGA geometries can have
+#define MOUSE_LAYER     1
+#define MOUSE_LAYERMODE LAYERMODE_SPRITEBLACK
+
+// Mouse connected or removed (USB callbacks)
+extern void mouse_attach(bool on);
+
+// Mouse movement and buttons (boot report)
+extern void mouse_report(u8 buttons, s8 dx, s8 dy, s8 wheel);
+
+// Pointer layer setup, called when the videomode is set
+extern void mouse_video_setup(const sVmode *vmode, int width, int height, int top, int cellh);
+
+// Mouse tracking modes (DECSET 1000, 1002, 1003 and 1006)
+extern void mouse_tracking(int mode, bool on);
+
+// Sends coalesced reports, called from the main loop
+extern void mouse_task(void);
+
+#endif
@@ -0,0 +1,535 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Scrollback history
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "include.h"
+
+// Screen dimensions
+#define COLUMNS     TEXTW
+
+// Lines are stored compressed as records in a circular arena:
+//   nchars       characters stored (trailing spaces are dropped)
+//   width        width of the screen when the line was stored
+//   nruns        number of color runs
+//   chars        nchars bytes
+//   runs         nruns x (count, background, foreground)
+//   size         record size (2 bytes), to walk back from the newest line
+// When there is no room for a new line, the oldest lines are evicted.
+#define SB_HEADER   3
+#define SB_FOOTER   2
+
+static u8 arena[SB_ARENA];
+static int sb_head = 0;     // where the next record will be written
+static int sb_tail = 0;     // oldest record
+static int sb_used = 0;     // bytes in use
+static int sb_count = 0;    // number of lines stored
+static u32 sb_next = 0;     // number of the next line to be stored (the oldest is sb_next-sb_count)
+
+// Search index
+// Lines are grouped in blocks of SB_BLKLINES lines, each block has a bloom
+// filter with the trigrams of its lines (case insensitive). A search only
+// decompresses the blocks that may contain all the trigrams of the text.
+// When the index is full, the oldest lines are evicted.
+#define SB_BLKLINES 8
+#define SB_BLOCKS   96      // 768 lines, about 48 lines per KB of arena
+#define SB_BLOOM    16      // bloom filter size in 32-bit words (512 bits)
+typedef struct {
+    u32 bloom[SB_BLOOM];
+    int pos;                // arena position of the first line of the block
+} SB_BLOCK;
+static SB_BLOCK sb_block[SB_BLOCKS];
+
+// Search state
+#define SB_MAXQUERY 40
+static bool searching = false;
+static char query[SB_MAXQUERY+1];
+static int qlen = 0;
+static bool found = false;
+static u32 match_line;      // line number of the match (>= sb_next: live screen)
+static int match_col;
+
+// Characters of the lines of the last block expanded in a search
+static u8 blk_chars[SB_BLKLINES][MAXTEXTW];
+static u32 blk_num = 0xFFFFFFFF;
+
+// History view
+// The text segment is pointed to this window while viewing, the window is
+// the alternate screen buffer (so there is no history view while the
+// alternate screen is shown)
+static u8 *ViewBuf = NULL;
+static int sb_offset = 0;   // lines back from the live screen (0 = live screen)
+
+// Local rotines
+static void show_view(void);
+static void show_match(void);
+
+// Arena access, positions wrap around
+static inline int sb_wrap(int pos) {
+    if (pos >= SB_ARENA) {
+        return pos - SB_ARENA;
+    }
+    if (pos < 0) {
+        return pos + SB_ARENA;
+    }
+    return pos;
+}
+
+static inline u8 sb_get(int pos) {
+    return arena[sb_wrap(pos)];
+}
+
+static inline int sb_put(int pos, u8 val) {
+    arena[pos] = val;
+    return sb_wrap(pos+1);
+}
+
+// Size of the record at pos
+static int sb_size(int pos) {
+    return SB_HEADER + sb_get(pos) + 3*sb_get(pos+2) + SB_FOOTER;
+}
+
+// Discard the oldest line
+static void evict_oldest() {
+    int s = sb_size(sb_tail);
+    sb_tail = sb_wrap(sb_tail + s);
+    sb_used -= s;
+    sb_count--;
+}
+
+// Case insensitive compare
+static inline u8 fold(u8 c) {
+    return ((c >= 'A') && (c <= 'Z')) ? c + ('a'-'A') : c;
+}
+
+// Bloom filter bit for a trigram
+static inline u32 trigram_bit(u8 a, u8 b, u8 c) {
+    u32 h = (fold(a) << 16) | (fold(b) << 8) | fold(c);
+    return ((h * 2654435761u) >> 23) & 0x1FF;
+}
+
+// Store a line scrolled off the top of the screen
+void scrollback_push(const u8 *line, int width) {
+    // characters to store
+    int nchars = width;
+    while ((nchars > 0) && (line[3*(nchars-1)] == ' ')) {
+        nchars--;
+    }
+
+    // color runs to store
+    int nruns = 1;
+    for (int i = 1; i < width; i++) {
+        if ((line[3*i+1] != line[3*i-2]) || (line[3*i+2] != line[3*i-1])) {
+            nruns++;
+        }
+    }
+
+    // make room in the arena and in the index, evicting the oldest lines
+    int size = SB_HEADER + nchars + 3*nruns + SB_FOOTER;
+    while ((SB_ARENA - sb_used) < size) {
+        evict_oldest();
+    }
+    while ((sb_next/SB_BLKLINES - (sb_next-sb_count)/SB_BLKLINES) >= SB_BLOCKS) {
+        evict_oldest();
+    }
+
+    // index the line
+    SB_BLOCK *blk = &sb_block[(sb_next/SB_BLKLINES) % SB_BLOCKS];
+    if ((sb_next % SB_BLKLINES) == 0) {
+        memset(blk->bloom, 0, sizeof(blk->bloom));
+        blk->pos = sb_head;
+    }
+    for (int i = 2; i < nchars; i++) {
+        u32 bit = trigram_bit(line[3*i-6], line[3*i-3], line[3*i]);
+        blk->bloom[bit >> 5] |= 1u << (bit & 31);
+    }
+    blk_num = 0xFFFFFFFF;
+
+    // write the record
+    int pos = sb_head;
+    pos = sb_put(pos, nchars);
+    pos = sb_put(pos, width);
+    pos = sb_put(pos, nruns);
+    for (int i = 0; i < nchars; i++) {
+        pos = sb_put(pos, line[3*i]);
+    }
+    int start = 0;
+    for (int i = 1; i <= width; i++) {
+        if ((i == width) || (line[3*i+1] != line[3*i-2]) || (line[3*i+2] != line[3*i-1])) {
+            pos = sb_put(pos, i - start);
+            pos = sb_put(pos, line[3*start+1]);
+            pos = sb_put(pos, line[3*start+2]);
+            start = i;
+        }
+    }
+    pos = sb_put(pos, size & 0xFF);
+    pos = sb_put(pos, size >> 8);
+    sb_head = pos;
+    sb_used += size;
+    sb_count++;
+    sb_next++;
+
+    // keep viewing the same lines
+    if (sb_offset > 0) {
+        sb_offset++;
+    }
+    if (sb_offset > sb_count) {
+        sb_offset = sb_count;
+    }
+}
+
+// Expand the record at pos into a screen line
+// Returns the position of the next record
+static int decode_line(int pos, u8 *row) {
+    int nchars = sb_get(pos);
+    int nruns = sb_get(pos+2);
+
+    // characters
+    int p = sb_wrap(pos + SB_HEADER);
+    for (int i = 0; i < COLUMNS; i++) {
+        row[3*i] = (i < nchars) ? sb_get(p+i) : ' ';
+    }
+
+    // colors
+    p = sb_wrap(p + nchars);
+    u8 bkg = color_bkg;
+    u8 chr = color_chr;
+    int col = 0;
+    for (int r = 0; r < nruns; r++) {
+        int n = sb_get(p);
+        bkg = sb_get(p+1);
+        chr = sb_get(p+2);
+        p = sb_wrap(p+3);
+        for (; (n > 0) && (col < COLUMNS); n--, col++) {
+            row[3*col+1] = bkg;
+            row[3*col+2] = chr;
+        }
+    }
+    // line was narrower than the screen
+    for (; col < COLUMNS; col++) {
+        row[3*col+1] = bkg;
+        row[3*col+2] = chr;
+    }
+
+    return sb_wrap(p + SB_FOOTER);
+}
+
+// Borrow the buffer for the history window
+static bool open_view() {
+    if (ViewBuf == NULL) {
+        ViewBuf = borrow_alt_screen();
+    }
+    return ViewBuf != NULL;
+}
+
+// Build the history window
+static void show_view() {
+    // find the line at the top of the window
+    int pos = sb_head;
+    for (int i = 0; i < sb_offset; i++) {
+        int s = sb_get(pos-2) | (sb_get(pos-1) << 8);
+        pos = sb_wrap(pos - s);
+    }
+
+    // history lines (without attributes), then the top of the live screen
+    for (int l = 0; l < nlines; l++) {
+        u8 *row = ViewBuf + l*TEXTWB;
+        u8 *atr = ATTRBUF(ViewBuf) + l*TEXTW;
+        if (l < sb_offset) {
+            pos = decode_line(pos, row);
+            memset(atr, 0, TEXTW);
+        } else {
+            memcpy(row, ScrBuf + (l-sb_offset)*TEXTWB, TEXTWB);
+            memcpy(atr, ATTRBUF(ScrBuf) + (l-sb_offset)*TEXTW, TEXTW);
+        }
+    }
+
+    // status line shows the position in the history
+    if (show_sl) {
+        char buf[60];
+        u8 *row = ViewBuf + nlines*TEXTWB;
+        memset(ATTRBUF(ViewBuf) + nlines*TEXTW, 0, TEXTW);
+        sprintf(buf, "HISTORY -%d/%d  %d lines/KB", sb_offset, sb_count,
+            scrollback_lines_per_kb());
+        for (int i = 0; i < COLUMNS; i++) {
+            row[3*i] = ' ';
+            row[3*i+1] = color_sl_bkg;
+            row[3*i+2] = color_sl_chr;
+        }
+        for (int i = 0; (buf[i] != 0) && (i < COLUMNS); i++) {
+            row[3*i] = buf[i];
+        }
+    }
+}
+
+// Move one page back (up) or forward in the history
+void scrollback_page(bool up) {
+    if (up) {
+        if (sb_count == 0) {
+            return;
+        }
+        sb_offset += nlines;
+        if (sb_offset > sb_count) {
+            sb_offset = sb_count;
+        }
+    } else {
+        sb_offset -= nlines;
+        if (sb_offset <= 0) {
+            scrollback_live();
+            return;
+        }
+    }
+    if (!open_view()) {
+        sb_offset = 0;
+        return;
+    }
+    show_view();
+    VideoSetText(ViewBuf);
+}
+
+// Go back to the live screen
+void scrollback_live() {
+    sb_offset = 0;
+    searching = false;
+    VideoSetText(ScrBuf);
+    if (ViewBuf != NULL) {
+        ViewBuf = NULL;
+        return_alt_screen();
+    }
+}
+
+bool scrollback_viewing() {
+    return (sb_offset > 0) || searching;
+}
+
+// Screen buffer shown while viewing the history
+u8 *scrollback_buffer() {
+    return ViewBuf;
+}
+
+// Check if a block may contain the text searched
+static bool block_may_match(u32 b) {
+    if (qlen < 3) {
+        return true;
+    }
+    SB_BLOCK *blk = &sb_block[b % SB_BLOCKS];
+    for (int i = 2; i < qlen; i++) {
+        u32 bit = trigram_bit(query[i-2], query[i-1], query[i]);
+        if ((blk->bloom[bit >> 5] & (1u << (bit & 31))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Expand the characters of the lines of a block
+static void expand_block(u32 b) {
+    if (b == blk_num) {
+        return;
+    }
+    u32 first = sb_next - sb_count;
+    u32 n = b*SB_BLKLINES;
+    int pos = sb_block[b % SB_BLOCKS].pos;
+    if (n < first) {
+        // first lines of the block were evicted
+        n = first;
+        pos = sb_tail;
+    }
+    for (; (n < sb_next) && (n < (b+1)*SB_BLKLINES); n++) {
+        u8 *p = blk_chars[n % SB_BLKLINES];
+        int nchars = sb_get(pos);
+        for (int i = 0; i < MAXTEXTW; i++) {
+            p[i] = (i < nchars) ? sb_get(pos + SB_HEADER + i) : ' ';
+        }
+        pos = sb_wrap(pos + sb_size(pos));
+    }
+    blk_num = b;
+}
+
+// Find the text in a line (width characters, every step bytes)
+// Returns the column or -1
+static int find_in_line(const u8 *p, int step, int width) {
+    for (int c = 0; c <= (width - qlen); c++) {
+        int i = 0;
+        while ((i < qlen) && (fold(p[(c+i)*step]) == fold(query[i]))) {
+            i++;
+        }
+        if (i == qlen) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// Search from line n in one direction (lines >= sb_next are in the live screen)
+static bool search(u32 n, bool older) {
+    u32 first = sb_next - sb_count;
+    u32 last = sb_next + nlines - 1;
+    while ((n >= first) && (n <= last)) {
+        int col;
+        if (n >= sb_next) {
+            col = find_in_line(ScrBuf + (n-sb_next)*TEXTWB, 3, COLUMNS);
+        } else {
+            u32 b = n / SB_BLKLINES;
+            if (!block_may_match(b)) {
+                // skip the whole block
+                if (older) {
+                    if (b*SB_BLKLINES == 0) {
+                        break;
+                    }
+                    n = b*SB_BLKLINES - 1;
+                } else {
+                    n = (b+1)*SB_BLKLINES;
+                }
+                continue;
+            }
+            expand_block(b);
+            col = find_in_line(blk_chars[n % SB_BLKLINES], 1, COLUMNS);
+        }
+        if (col >= 0) {
+            found = true;
+            match_line = n;
+            match_col = col;
+            return true;
+        }
+        if (older) {
+            if (n == 0) {
+                break;
+            }
+            n--;
+        } else {
+            n++;
+        }
+    }
+    return false;
+}
+
+// Start incremental search
+void scrollback_search() {
+    if (!open_view()) {
+        return;
+    }
+    searching = true;
+    qlen = 0;
+    query[0] = 0;
+    found = false;
+    show_match();
+}
+
+bool scrollback_searching() {
+    return searching;
+}
+
+// Handle a key in search mode
+//   printable chars and BS edit the text, UP/DOWN go to the previous/next match,
+//   ENTER stays at the match and ESC goes back to the live screen
+void scrollback_search_key(u8 key) {
+    u32 newest = sb_next + nlines - 1;
+    if (key == ESC) {
+        scrollback_live();
+        return;
+    } else if (key == CR) {
+        searching = false;
+        if (sb_offset == 0) {
+            scrollback_live();
+        } else {
+            show_view();
+        }
+        return;
+    } else if ((key == BSP) || (key == DEL)) {
+        if (qlen > 0) {
+            query[--qlen] = 0;
+            found = false;
+            if (qlen > 0) {
+                search(newest, true);
+            }
+        }
+    } else if ((key == KEY_UP) || (key == KEY_SH_PGUP)) {
+        if (found && (match_line > 0)) {
+            search(match_line-1, true);
+        }
+    } else if ((key == KEY_DWN) || (key == KEY_SH_PGDN)) {
+        if (found) {
+            search(match_line+1, false);
+        }
+    } else if ((key >= 0x20) && (key < 0x7F) && (qlen < SB_MAXQUERY)) {
+        query[qlen++] = key;
+        query[qlen] = 0;
+        // refine the search from the current match
+        u32 from = found ? match_line : newest;
+        found = false;
+        search(from, true);
+    }
+    show_match();
+}
+
+// Show the current match, with the matches in the window highlighted
+static void show_match() {
+    // position the window around the match
+    if (found && (match_line < sb_next)) {
+        int back = sb_next - match_line;
+        sb_offset = back + nlines/2;
+        if (sb_offset > sb_count) {
+            sb_offset = sb_count;
+        }
+    } else if (found) {
+        sb_offset = 0;
+    }
+    show_view();
+
+    // highlight the matches in the attribute plane, the renderer swaps
+    // their colors and underlines the current match
+    if (qlen > 0) {
+        for (int l = 0; l < nlines; l++) {
+            u8 *row = ViewBuf + l*TEXTWB;
+            u8 *atr = ATTRBUF(ViewBuf) + l*TEXTW;
+            int c0 = 0;
+            int col;
+            while ((col = find_in_line(row + 3*c0, 3, COLUMNS - c0)) >= 0) {
+                col += c0;
+                bool current = found && (l == (int) (match_line - sb_next + sb_offset)) &&
+                               (col == match_col);
+                for (int i = col; i < col+qlen; i++) {
+                    mark_selected(row + 3*i, atr + i, true);
+                    if (current) {
+                        atr[i] |= ATR_UNDERLINE;
+                    }
+                }
+                c0 = col + qlen;
+            }
+        }
+    }
+
+    // search prompt in the last line
+    u8 *row = ViewBuf + (TEXTH-1)*TEXTWB;
+    memset(ATTRBUF(ViewBuf) + (TEXTH-1)*TEXTW, 0, TEXTW);
+    char buf[SB_MAXQUERY+30];
+    sprintf(buf, "SEARCH: %s_ %s", query, (found || (qlen == 0)) ? "" : "(not found)");
+    for (int i = 0; i < COLUMNS; i++) {
+        row[3*i] = (i < (int) strlen(buf)) ? buf[i] : ' ';
+        row[3*i+1] = color_sl_bkg;
+        row[3*i+2] = color_sl_chr;
+    }
+    VideoSetText(ViewBuf);
+}
+
+// Capacity report
+int scrollback_lines() {
+    return sb_count;
+}
+
+int scrollback_lines_per_kb() {
+    return (sb_used == 0) ? 0 : (sb_count * 1024) / sb_used;
+}
@@ -0,0 +1,45 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Scrollback history
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _SCROLLBACK_H
+#define _SCROLLBACK_H
+
+// Size of the history arena in bytes
+// The two 132x96 screen buffers (TextBuf and AltBuf, which also holds the
+// history window) take 100KB of the SRAM, the history and its index are
+// sized to leave room for the renderers copied to RAM, the stacks and the heap
+#define SB_ARENA    (16*1024)
+
+// Store a line scrolled off the top of the screen
+extern void scrollback_push(const u8 *line, int width);
+
+// History viewing
+extern void scrollback_page(bool up);
+extern void scrollback_live(void);
+extern bool scrollback_viewing(void);
+extern u8 *scrollback_buffer(void);
+
+// Incremental search
+extern void scrollback_search(void);
+extern bool scrollback_searching(void);
+extern void scrollback_search_key(u8 key);
+
+// Capacity report
+extern int scrollback_lines(void);
+extern int scrollback_lines_per_kb(void);
+
+#endif
@@ -0,0 +1,339 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Local text selection, clipboard and paste
+ *
+ * The selected cells are marked with ATR_SELECT in the attribute plane of
+ * the screen shown, the renderer swaps their colors (at 132 columns, where
+ * the attributes are not drawn, mark_selected swaps them in the cells).
+ * Only the lines that change are repainted as the selection grows or
+ * shrinks.
+ *
+ * Copying reads the characters straight from the screen lines into the
+ * clipboard, in UTF-8 (trailing spaces removed, a line break between
+ * lines). The paste is sent by paste_task() from the main loop, a few
+ * bytes at a time while the TX buffer has room, so received data is still
+ * handled during a long paste. The other senders (keys, macros, scanner
+ * bursts and mouse events) wait while paste_active(), so nothing else gets
+ * inside the paste.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "include.h"
+
+// Screen dimensions
+#define COLUMNS     TEXTW
+
+// Clipboard
+u8 clipboard[CLIP_SIZE];
+int clip_len = 0;
+
+// Selection
+static bool sel_active = false;     // selection being made
+static bool sel_marked = false;     // there are cells marked in the screen
+static bool sel_rect;
+static scrpos sel_anchor;           // where the selection started
+static scrpos sel_point;            // where it ends now
+static bool kbd_mode = false;       // keyboard selection mode
+
+// Paste
+// Bytes are sent while the TX buffer has more than PASTE_ROOM free, the
+// rest is left for the replies to the host requests
+#define PASTE_ROOM  16
+static bool bracketed = false;      // bracketed paste mode (DECSET 2004)
+static bool pasting = false;
+static int paste_pos;
+static const char paste_begin[] = "\x1B[200~";
+static const char paste_end[] = "\x1B[201~";
+
+// Lines of the screen shown
+static inline u8 *sel_line(int row) {
+    return scrollback_viewing() ? scrollback_buffer() + row*TEXTWB : screen_line(row);
+}
+
+static inline u8 *sel_attr(int row) {
+    return ATTRBUF(scrollback_viewing() ? scrollback_buffer() : ScrBuf) + row*COLUMNS;
+}
+
+// Top and bottom lines of the selection
+static inline int sel_top() {
+    return (sel_anchor.y < sel_point.y) ? sel_anchor.y : sel_point.y;
+}
+
+static inline int sel_bottom() {
+    return (sel_anchor.y > sel_point.y) ? sel_anchor.y : sel_point.y;
+}
+
+// First and last columns selected in a line
+static void sel_columns(int row, int *first, int *last) {
+    if (sel_rect) {
+        *first = (sel_anchor.x < sel_point.x) ? sel_anchor.x : sel_point.x;
+        *last = (sel_anchor.x > sel_point.x) ? sel_anchor.x : sel_point.x;
+        return;
+    }
+    const scrpos *start = &sel_anchor;
+    const scrpos *end = &sel_point;
+    if ((sel_point.y < sel_anchor.y) || ((sel_point.y == sel_anchor.y) && (sel_point.x < sel_anchor.x))) {
+        start = &sel_point;
+        end = &sel_anchor;
+    }
+    *first = (row == start->y) ? start->x : 0;
+    *last = (row == end->y) ? end->x : COLUMNS-1;
+}
+
+// Mark the selected cells in lines top to bottom
+static void sel_paint(int top, int bottom) {
+    for (int row = top; row <= bottom; row++) {
+        int first = COLUMNS, last = -1;
+        if (sel_active && (row >= sel_top()) && (row <= sel_bottom())) {
+            sel_columns(row, &first, &last);
+        }
+        u8 *line = sel_line(row);
+        u8 *atr = sel_attr(row);
+        for (int c = 0; c < COLUMNS; c++) {
+            mark_selected(line + 3*c, atr + c, (c >= first) && (c <= last));
+        }
+    }
+    sel_marked = true;
+}
+
+// Start a selection
+void select_start(int col, int row, bool rect) {
+    select_clear();
+    sel_rect = rect;
+    sel_anchor.x = sel_point.x = col;
+    sel_anchor.y = sel_point.y = row;
+    sel_active = true;
+    sel_paint(row, row);
+}
+
+// Move the end of the selection
+void select_extend(int col, int row) {
+    if (!sel_active || ((col == sel_point.x) && (row == sel_point.y))) {
+        return;
+    }
+    int top = sel_top();
+    int bottom = sel_bottom();
+    if (!sel_rect) {
+        // lines between the old and the new end change
+        top = (sel_point.y < row) ? sel_point.y : row;
+        bottom = (sel_point.y > row) ? sel_point.y : row;
+    }
+    sel_point.x = col;
+    sel_point.y = row;
+    top = (top < sel_top()) ? top : sel_top();
+    bottom = (bottom > sel_bottom()) ? bottom : sel_bottom();
+    sel_paint(top, bottom);
+}
+
+// Put a code point in UTF-8, returns the number of bytes (0 if no room)
+static int utf8_encode(u32 cp, u8 *out, int room) {
+    if (cp < 0x80) {
+        if (room < 1) {
+            return 0;
+        }
+        out[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        if (room < 2) {
+            return 0;
+        }
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (room < 3) {
+        return 0;
+    }
+    out[0] = 0xE0 | (cp >> 12);
+    out[1] = 0x80 | ((cp >> 6) & 0x3F);
+    out[2] = 0x80 | (cp & 0x3F);
+    return 3;
+}
+
+// Copy the selection to the clipboard
+// The selection stays marked until the next key or selection
+// Returns false if nothing was selected (a click without moving)
+bool select_copy() {
+    if (!sel_active) {
+        return false;
+    }
+    sel_active = false;
+    if ((sel_anchor.x == sel_point.x) && (sel_anchor.y == sel_point.y)) {
+        select_clear();
+        return false;
+    }
+    int n = 0;
+    for (int row = sel_top(); row <= sel_bottom(); row++) {
+        int first, last;
+        sel_columns(row, &first, &last);
+        const u8 *p = sel_line(row);
+        while ((last >= first) && (p[3*last] == ' ')) {
+            last--;
+        }
+        if ((row != sel_top()) && (n < CLIP_SIZE)) {
+            clipboard[n++] = '\n';
+        }
+        for (int c = first; c <= last; c++) {
+            int len = utf8_encode(charset_code(p[3*c]), clipboard + n, CLIP_SIZE - n);
+            if (len == 0) {
+                break;      // clipboard full
+            }
+            n += len;
+        }
+    }
+    clip_len = n;
+    return true;
+}
+
+// Remove the selection marks
+// The marks move with the text when the screen scrolls, all the
+// attribute planes are cleared
+void select_clear() {
+    sel_active = false;
+    if (!sel_marked) {
+        return;
+    }
+    const u32 mask = ~(ATR_SELECT * 0x01010101u);
+    u8 *planes[2] = { TextBuf, AltBuf };    // the history window is in AltBuf
+    for (int i = 0; i < 2; i++) {
+        if (VideoAttributes()) {
+            u32 *p = (u32 *) ATTRBUF(planes[i]);
+            for (int n = COLUMNS*TEXTH/4; n > 0; n--) {
+                *p++ &= mask;
+            }
+        } else {
+            // the colors of the marked cells are swapped back
+            u8 *atr = ATTRBUF(planes[i]);
+            for (int n = 0; n < COLUMNS*TEXTH; n++) {
+                if (atr[n] & ATR_SELECT) {
+                    mark_selected(planes[i] + 3*n, atr + n, false);
+                }
+            }
+        }
+    }
+    sel_marked = false;
+}
+
+// Start the keyboard selection mode, at the cursor in the live screen
+// and at the top of the history window
+void select_keyboard() {
+    kbd_mode = true;
+    if (scrollback_viewing()) {
+        select_start(0, 0, false);
+    } else {
+        select_start(csr.x, (csr.y < nlines) ? csr.y : nlines-1, false);
+    }
+}
+
+bool select_keyboard_mode() {
+    return kbd_mode;
+}
+
+// Handle a key in keyboard selection mode
+//   cursor keys, HOME and END move the end of the selection, SPACE starts
+//   again at the current position, TAB changes between line and rectangle,
+//   ENTER copies the selection and ESC leaves without copying
+void select_key(u8 key) {
+    int x = sel_point.x;
+    int y = sel_point.y;
+    switch (key) {
+        case KEY_UP:
+            y = (y > 0) ? y-1 : y;
+            break;
+        case KEY_DWN:
+            y = (y < nlines-1) ? y+1 : y;
+            break;
+        case KEY_LFT:
+            x = (x > 0) ? x-1 : x;
+            break;
+        case KEY_RGT:
+            x = (x < COLUMNS-1) ? x+1 : x;
+            break;
+        case KEY_HOME:
+            x = 0;
+            break;
+        case KEY_END:
+            x = COLUMNS-1;
+            break;
+        case ' ':
+            select_start(x, y, sel_rect);
+            return;
+        case HT:
+            sel_rect = !sel_rect;
+            sel_paint(sel_top(), sel_bottom());
+            return;
+        case CR:
+            kbd_mode = false;
+            select_copy();
+            return;
+        case ESC:
+            kbd_mode = false;
+            select_clear();
+            return;
+        default:
+            return;
+    }
+    select_extend(x, y);
+}
+
+// Start sending the clipboard
+void paste_start() {
+    if ((clip_len == 0) || (term_mode != ONLINE)) {
+        return;
+    }
+    pasting = true;
+    paste_pos = bracketed ? -(int) strlen(paste_begin) : 0;
+}
+
+bool paste_active() {
+    return pasting;
+}
+
+void paste_bracketed(bool on) {
+    bracketed = on;
+}
+
+// Send the next part of the paste
+// Line breaks are sent as CR (the ENTER key), ESC is removed from a
+// bracketed paste so the text can't end it early
+void paste_task() {
+    if (!pasting) {
+        return;
+    }
+    if (term_mode != ONLINE) {
+        pasting = false;
+        return;
+    }
+    while (tx_room() > PASTE_ROOM) {
+        if (paste_pos < 0) {
+            // start of a bracketed paste
+            put_tx(paste_begin[strlen(paste_begin) + paste_pos]);
+            paste_pos++;
+        } else if (paste_pos < clip_len) {
+            u8 ch = clipboard[paste_pos++];
+            if (ch == '\n') {
+                put_tx(CR);
+            } else if (!bracketed || (ch != ESC)) {
+                put_tx(ch);
+            }
+        } else {
+            if (bracketed) {
+                put_tx_buf((const u8 *) paste_end, strlen(paste_end));
+            }
+            pasting = false;
+            return;
+        }
+    }
+}
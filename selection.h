@@ -0,0 +1,45 @@
+/*
+ * RPTERM - Terminal software for Pi Pico
+ * USB keyboard input, VGA video output, communication via UART
+ * Daniel Quadros, https://dqsoft.blogspot.com
+ *
+ * Local text selection, clipboard and paste
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _SELECTION_H
+#define _SELECTION_H
+
+// Clipboard, set by a selection or by OSC 52
+#define CLIP_SIZE   4096
+extern u8 clipboard[CLIP_SIZE];
+extern int clip_len;
+
+// Selection in the screen shown (live screen or history window)
+// Line mode selects from the start to the end position in reading order,
+// rectangle mode selects the columns between them in each line
+extern void select_start(int col, int row, bool rect);
+extern void select_extend(int col, int row);
+extern bool select_copy(void);
+extern void select_clear(void);
+
+// Keyboard selection mode
+extern void select_keyboard(void);
+extern bool select_keyboard_mode(void);
+extern void select_key(u8 key);
+
+// Paste the clipboard to the host
+extern void paste_start(void);
+extern bool paste_active(void);
+extern void paste_bracketed(bool on);
+extern void paste_task(void);
+
+#endif
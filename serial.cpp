@@ -25,12 +25,23 @@
 #define RX_BUFFER_SIZE 1000
 static uint8_t buffer_rx[RX_BUFFER_SIZE];
 static int buf_rx_in, buf_rx_out;
+static volatile uint32_t rx_time;   // time (time_us_32) of the last char received
 
 // Tx buffer (i.e., data to the RC2014)
 #define TX_BUFFER_SIZE 100
 static uint8_t buffer_tx[TX_BUFFER_SIZE];
 static int buf_tx_in, buf_tx_out;
 
+// Latency marks: the last byte of a key in the Tx buffer, with the times
+// of its report and of its handling by the main loop
+#define TX_MARKS 8
+static struct {
+    int pos;
+    uint32_t t_report;
+    uint32_t t_key;
+} tx_mark[TX_MARKS];
+static int tx_mark_in, tx_mark_out;
+
 static void on_uart_rx();
 
 //--------------------------------------------------------------------+
@@ -87,11 +98,55 @@ void put_tx(uint8_t ch) {
     }
 }
 
+// Put a sequence to transmit in the buffer
+// The sequence is dropped if it does not fit, a partial escape sequence
+// would be misinterpreted by the host
+void put_tx_buf(const uint8_t *buf, int len) {
+    if (len > tx_room()) {
+        return;
+    }
+    for (int i = 0; i < len; i++) {
+        put_tx(buf[i]);
+    }
+}
+
+// Mark the last char put in the buffer as the end of a key
+// (extra marks are dropped if keys are queued faster than sent)
+void put_tx_mark(uint32_t t_report) {
+    int aux = (tx_mark_in + 1) % TX_MARKS;
+    int pos = (buf_tx_in == 0) ? TX_BUFFER_SIZE-1 : buf_tx_in-1;
+    int last = (tx_mark_in == 0) ? TX_MARKS-1 : tx_mark_in-1;
+    if ((buf_tx_in == buf_tx_out) || (aux == tx_mark_out)) {
+        return;     // nothing to mark or no room
+    }
+    if ((tx_mark_in != tx_mark_out) && (tx_mark[last].pos == pos)) {
+        return;     // the key did not put anything in the buffer
+    }
+    tx_mark[tx_mark_in].pos = pos;
+    tx_mark[tx_mark_in].t_report = t_report;
+    tx_mark[tx_mark_in].t_key = time_us_32();
+    tx_mark_in = aux;
+}
+
 // Test if buffer not empty
 static bool has_tx() {
     return buf_tx_in != buf_tx_out;
 }
 
+// Test if everything was sent to the UART
+bool tx_empty() {
+    return !has_tx();
+}
+
+// Free space in the buffer
+int tx_room() {
+    int used = buf_tx_in - buf_tx_out;
+    if (used < 0) {
+        used += TX_BUFFER_SIZE;
+    }
+    return TX_BUFFER_SIZE - 1 - used;
+}
+
 // Get next char from the buffer
 static uint8_t get_tx() {
     if (has_tx()) {
@@ -114,6 +169,7 @@ void serial_init() {
 
     buf_rx_in = buf_rx_out = 0;
     buf_tx_in = buf_tx_out = 0;
+    tx_mark_in = tx_mark_out = 0;
 
     uart_init(UART_ID, config_getbaudrate());
     uart_set_hw_flow(UART_ID,false,false);
@@ -161,7 +217,13 @@ void serial_config(uint baud, SERIAL_FMT fmt) {
 // UART Tx task
 void serial_tx_task() {
     if (has_tx() && uart_is_writable(UART_ID)) {
+        int pos = buf_tx_out;
         uart_putc (UART_ID, get_tx());
+        if ((tx_mark_in != tx_mark_out) && (tx_mark[tx_mark_out].pos == pos)) {
+            // last byte of a key is in the UART
+            latency_record(tx_mark[tx_mark_out].t_report, tx_mark[tx_mark_out].t_key, time_us_32());
+            tx_mark_out = (tx_mark_out + 1) % TX_MARKS;
+        }
     }
 }
 
@@ -170,4 +232,14 @@ static void on_uart_rx() {
     while (uart_is_readable(UART_ID)) {
         put_rx(uart_getc(UART_ID));
     }
+    rx_time = time_us_32();
+}
+
+// Wait for a pause of idle_ms in the received data, for up to max_ms
+// (the chars received meanwhile go to the buffer)
+void serial_rx_pause(uint32_t idle_ms, uint32_t max_ms) {
+    uint32_t start = time_us_32();
+    while (((time_us_32() - rx_time) < idle_ms*1000) && ((time_us_32() - start) < max_ms*1000)) {
+        tight_loop_contents();
+    }
 }
@@ -27,8 +27,13 @@ extern bool has_rx(void);
 extern void put_rx(uint8_t ch);
 extern uint8_t get_rx(void);
 extern void put_tx(uint8_t ch);
+extern void put_tx_buf(const uint8_t *buf, int len);
+extern void put_tx_mark(uint32_t t_report);
+extern bool tx_empty(void);
+extern int tx_room(void);
 extern void serial_init(void);
 extern void serial_config(uint baud, SERIAL_FMT fmt);
 extern void serial_tx_task(void);
+extern void serial_rx_pause(uint32_t idle_ms, uint32_t max_ms);
 
 #endif
\ No newline at end of file
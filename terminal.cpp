@@ -29,100 +29,295 @@
 #define ESC_READY               0
 #define ESC_ESC_RECEIVED        1
 #define ESC_PARAMETER_READY     2
+#define ESC_CHARSET             3
+#define ESC_STRING              4
 
-#define MAX_ESC_PARAMS          5
+#define MAX_ESC_PARAMS          16
+#define MAX_ESC_VALUE           9999
 static int esc_state = ESC_READY;
 static int esc_parameters[MAX_ESC_PARAMS];
+static u16 esc_subparam;        // bit n set if parameter n follows a ':'
 static bool parameter_q;
 static int esc_parameter_count;
 static unsigned char esc_c1;
 static unsigned char esc_final_byte;
 
+// String sequences (OSC, DCS, APC, PM and SOS), ended by BEL or ST (ESC and '\')
+// Only OSC is interpreted: the command number is parsed as it arrives and
+// the text goes to a small buffer; strings that are not wanted (or do
+// not fit) are discarded as they arrive
+#define STR_BUFSIZE     128
+static int str_cmd;                 // OSC command number, -1 while not known
+static bool str_discard;            // ignore the rest of the string
+static u8 str_buf[STR_BUFSIZE+1];   // current item of the string
+static int str_len;
+static int str_index;               // palette slot for the next color spec (0: none, -1: OSC 4 index expected)
+
+// Clipboard set by OSC 52 (decoded from base64 as it arrives)
+static bool clip_data;              // selection parameter was skipped
+static u32 b64_acc;
+static int b64_bits;
+
+// Window title (OSC 0 and 2), shown in the status line
+static char sl_title[STR_BUFSIZE+1];
+
+// Character sets (G0 to G3)
+// A NULL translation table is ASCII, characters are used without translation
+static const u8 *gset[4];
+static u8 gl_set;           // set invoked in GL (locking shift)
+static const u8 *gl_map;    // translation for the next character
+static bool single_shift;   // gl_map was changed by SS2 or SS3
+
+// UTF-8 decoder state
+static u8 utf8_need;        // continuation bytes still expected
+static u32 utf8_cp;         // code point being decoded
+static u32 utf8_min;        // smallest code point for the sequence length
+
 // configurations
-u8 color_chr = COL_WHITE;
-u8 color_bkg = COL_SEMIBLUE;
-u8 color_sl_chr = COL_WHITE;
-u8 color_sl_bkg = COL_BLUE;
+// colors are palette indexes
+u8 color_chr = PAL_DEF_FG;
+u8 color_bkg = PAL_DEF_BG;
+u8 color_chr_alt = PAL_DEF_FG;      // colors for odd cells (dithering)
+u8 color_bkg_alt = PAL_DEF_BG;
+u8 color_sl_chr = PAL_SL_FG;
+u8 color_sl_bkg = PAL_SL_BG;
 bool autowrap = true, bserases = false, cr_crlf = false, lf_crlf = false;
 
-// color available to ANSI commands
-static const u8 ansi_pallet[] = {
-    COL_BLACK, COL_RED, COL_GREEN, COL_YELLOW, COL_BLUE, COL_MAGENTA, COL_CYAN, COL_WHITE
+u8 color_atr = 0;
+
+// Direct RGB colors (38;2 and 48;2) are dithered if SGR_DITHER is 1:
+// the color components are quantised with different thresholds in even
+// and odd cells, so adjacent cells alternate between the two nearest colors
+#define SGR_DITHER  1
+
+// Quantisation tables to the R3G3B2 format, generated at compile time
+// lev8 (red and green) and lev4 (blue) give the level for a 0-255 component,
+// [0] is used for even cells and [1] for odd cells
+// xterm has the palette indexes for the colors 16 to 255 of the 256 color
+// palette (6x6x6 cube followed by a 24 step gray ramp)
+struct QuantTables {
+    u8 lev8[2][256];
+    u8 lev4[2][256];
+    u8 xterm[240];
+
+    // level for component v with L levels, threshold tq in quarters
+    static constexpr u8 level(int v, int L, int tq) {
+        int l = (v*(L-1)*4 + tq*255) / 1020;
+        return (l > (L-1)) ? (L-1) : l;
+    }
+
+    constexpr QuantTables() : lev8(), lev4(), xterm() {
+        for (int d = 0; d < 2; d++) {
+            int tq = SGR_DITHER ? (1 + 2*d) : 2;
+            for (int v = 0; v < 256; v++) {
+                lev8[d][v] = level(v, 8, tq);
+                lev4[d][v] = level(v, 4, tq);
+            }
+        }
+        const int cube[6] = { 0, 95, 135, 175, 215, 255 };
+        for (int n = 0; n < 216; n++) {
+            int r = cube[n / 36], g = cube[(n / 6) % 6], b = cube[n % 6];
+            xterm[n] = PAL_DIRECT((level(r, 8, 2) << 5) | (level(g, 8, 2) << 2) | level(b, 4, 2));
+        }
+        for (int n = 0; n < 24; n++) {
+            int v = 8 + 10*n;
+            xterm[216+n] = PAL_DIRECT((level(v, 8, 2) << 5) | (level(v, 8, 2) << 2) | level(v, 4, 2));
+        }
+    }
+};
+static constexpr QuantTables quant;
+
+// SGR state
+// Colors are an ANSI color (0 to 15) or a direct color (SGR_DIRECT)
+// Direct colors are a pair of palette indexes, for even and odd cells
+// The colors used in the screen are calculated when the state changes
+#define SGR_DIRECT  0xFF
+static u8 sgr_fg = SGR_DIRECT, sgr_bg = SGR_DIRECT;
+static u8 sgr_fg_col[2] = { PAL_DEF_FG, PAL_DEF_FG };
+static u8 sgr_bg_col[2] = { PAL_DEF_BG, PAL_DEF_BG };
+
+// Attributes set and cleared by SGR 0 to 29
+static const u8 sgr_set[30] = {
+    0, ATR_BOLD, ATR_DIM, ATR_ITALIC, ATR_UNDERLINE, ATR_BLINK, ATR_BLINK, ATR_REVERSE, ATR_HIDDEN, ATR_STRIKE,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, ATR_UNDERLINE, 0, 0, 0, 0, 0, 0, 0, 0
+};
+static const u8 sgr_clr[30] = {
+    0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, ATR_BOLD|ATR_DIM, ATR_ITALIC, ATR_UNDERLINE, ATR_BLINK, 0, ATR_REVERSE, ATR_HIDDEN, ATR_STRIKE
 };
 
 // Saved cursor
 struct scrpos saved_csr = {0,0};
+static struct scrpos other_saved_csr = {0,0};   // of the screen not shown
+
+// Keyboard modes
+static bool app_cursor = false;     // DECCKM: cursor keys send SS3
+static bool app_keypad = false;     // DECKPAM: keypad sends SS3
+
+// Special keys sequences (as xterm)
+// Keys without a number are sent as ESC intro final, the intro depends on
+// DECCKM; keys with a number are sent as CSI number ~
+// With modifiers the sequences are CSI 1 ; m final and CSI number ; m ~,
+// where m is 1 + 1 (shift) + 2 (alt) + 4 (ctrl)
+typedef struct {
+    char intro[2];      // normal, application cursor
+    char final;
+    u8 num;
+} KEY_SEQ;
+
+static const KEY_SEQ key_seq[16] = {        // KEY_UP to KEY_F10
+    { { '[', 'O' }, 'A', 0 },   // UP
+    { { '[', 'O' }, 'B', 0 },   // DOWN
+    { { '[', 'O' }, 'D', 0 },   // LEFT
+    { { '[', 'O' }, 'C', 0 },   // RIGHT
+    { { '[', 'O' }, 'H', 0 },   // HOME
+    { { '[', 'O' }, 'F', 0 },   // END
+    { { 'O', 'O' }, 'P', 0 },   // F1
+    { { 'O', 'O' }, 'Q', 0 },   // F2
+    { { 'O', 'O' }, 'R', 0 },   // F3
+    { { 'O', 'O' }, 'S', 0 },   // F4
+    { { '[', '[' }, '~', 15 },  // F5
+    { { '[', '[' }, '~', 17 },  // F6
+    { { '[', '[' }, '~', 18 },  // F7
+    { { '[', '[' }, '~', 19 },  // F8
+    { { '[', '[' }, '~', 20 },  // F9
+    { { '[', '[' }, '~', 21 }   // F10
+};
 
-// Special keys sequences
-static char const *keysequence[] = {
-    "\x1B[A",  // UP
-    "\x1B[B",  // DOWN
-    "\x1B[D",  // LEFT
-    "\x1B[C",  // RIGHT
-    "\x1B[H",  // HOME
-    "\x1B[K",  // END
-    "\x1B[OP", // F1
-    "\x1B[OQ", // F2
-    "\x1B[OR", // F3
-    "\x1B[OS", // F4
-    "\x1B[OT", // F5
-    "\x1B[OU", // F6
-    "\x1B[OV", // F7
-    "\x1B[OW", // F8
-    "\x1B[OX", // F9
-    "\x1B[OY"  // F10
+static const KEY_SEQ key_seq_ext[6] = {     // KEY_INS to KEY_F12
+    { { '[', '[' }, '~', 2 },   // INS
+    { { '[', '[' }, '~', 3 },   // DEL
+    { { '[', '[' }, '~', 5 },   // PAGE UP
+    { { '[', '[' }, '~', 6 },   // PAGE DOWN
+    { { '[', '[' }, '~', 23 },  // F11
+    { { '[', '[' }, '~', 24 }   // F12
 };
 
+// Keypad in application mode: chars and the SS3 finals
+static const char keypad_chr[] = "0123456789.\r-+*/";
+static const char keypad_app[] = "pqrstuvwxynMmkjo";
+
 // Status line control
 // .123456789.123456789.123456789.123456789.123456789.123456789.123456789.123456789
-// MODE      BAUD      ID                                                 L=XX C=XX
+// MODE      BAUD      ID                                                L=XX C=XXX
 #define SL_MODE 0
 #define SL_BAUD 10
 #define SL_ID   20
-#define SL_LC   71
-static int nlines = ROWS-1;
+#define SL_LC   (COLUMNS-10)
 
 // local rotines
 static void print_string(char *str);
 static void update_sl_lc(void);
+static void update_sl_title(void);
+static void set_columns(bool wide);
+static void set_alt_screen(int mode, bool on);
+static void select_graphic_rendition(void);
+static void put_glyph(u8 ch);
+static void utf8_decode(u8 chrx);
+static void invoke_charset(int g, bool single);
+static void start_string(u8 type);
+static void collect_string(u8 chrx);
+static void end_string(void);
 
-// Send a key, expanding sequences
-void send_key (uint8_t ch)
+// Encode a key as it is sent to the host
+// buf must have room for 8 bytes, returns the number of bytes
+int encode_key (KEY_EVENT ev, uint8_t *buf)
 {
-  if (ch > 0x7F)
+  uint8_t ch = ev.code;
+  int n = 0;
+  const KEY_SEQ *seq = NULL;
+
+  if ((ch >= KEY_UP) && (ch <= KEY_F10))
+  {
+    seq = &key_seq[ch - KEY_UP];
+  }
+  else if ((ch >= KEY_INS) && (ch <= KEY_F12))
+  {
+    seq = &key_seq_ext[ch - KEY_INS];
+  }
+
+  if (seq != NULL)
   {
     // special key
-    char const *seq = keysequence[ch - 0x80];
-    while (*seq)
+    int m = 1 + ((ev.mods & KMOD_SHIFT) ? 1 : 0) + ((ev.mods & KMOD_ALT) ? 2 : 0) + ((ev.mods & KMOD_CTRL) ? 4 : 0);
+    buf[n++] = ESC;
+    if (m > 1)
+    {
+      n += sprintf((char *) buf+n, "[%d;%d%c", seq->num ? seq->num : 1, m, seq->final);
+    }
+    else
     {
-      put_tx(*seq);
-      seq++;
+      buf[n++] = seq->intro[app_cursor ? 1 : 0];
+      if (seq->num)
+      {
+        n += sprintf((char *) buf+n, "%d", seq->num);
+      }
+      buf[n++] = seq->final;
     }
+    return n;
   }
-  else if (ch != 0)
+
+  if ((ev.mods & KMOD_KEYPAD) && app_keypad && (ch != 0))
   {
-    // normal key
-    put_tx(ch);
+    const char *p = strchr(keypad_chr, ch);
+    if (p != NULL)
+    {
+      buf[n++] = ESC;
+      buf[n++] = 'O';
+      buf[n++] = keypad_app[p - keypad_chr];
+      return n;
+    }
   }
-}
 
-// Simulate reception of a key
-void receive_key  (uint8_t ch)
-{
-  if (ch > 0x7F)
+  if ((ch == HT) && (ev.mods & KMOD_SHIFT))
   {
-    // special key
-    char const *seq = keysequence[ch - 0x80];
-    while (*seq)
+    // back tab
+    buf[n++] = ESC;
+    buf[n++] = '[';
+    buf[n++] = 'Z';
+    return n;
+  }
+
+  if ((ch < 0x80) || ((ch >= KEY_LATIN1) && (ch < KEY_LATIN1 + 0x60)))
+  {
+    if ((ev.mods & KMOD_ALT) && (ch != 0))
     {
-      put_rx(*seq);
-      seq++;
+      // meta sends ESC before the char
+      buf[n++] = ESC;
+    }
+    if (ch >= KEY_LATIN1)
+    {
+      // Latin-1 character, in UTF-8
+      uint cp = ch - KEY_LATIN1 + 0xA0;
+      buf[n++] = 0xC0 | (cp >> 6);
+      buf[n++] = 0x80 | (cp & 0x3F);
+    }
+    else if (ch != 0)
+    {
+      // normal key
+      buf[n++] = ch;
     }
   }
-  else if (ch != 0)
+  return n;
+}
+
+// Send a key, expanding sequences
+void send_key (KEY_EVENT ev)
+{
+  uint8_t buf[8];
+  put_tx_buf(buf, encode_key(ev, buf));
+}
+
+// Simulate reception of a key
+void receive_key  (KEY_EVENT ev)
+{
+  uint8_t buf[8];
+  int n = encode_key(ev, buf);
+  for (int i = 0; i < n; i++)
   {
-    // normal key
-    put_rx(ch);
+    put_rx(buf[i]);
   }
 }
 
@@ -132,6 +327,7 @@ static void clear_escape_parameters(){
         esc_parameters[i] = 0;
     }
     esc_parameter_count = 0;
+    esc_subparam = 0;
 }
 
 // Reset escape sequence processing
@@ -264,42 +460,58 @@ static void esc_sequence_received(){
                 if (parameter_q && (esc_parameters[0]==25)) {
                     // show csr
                     make_cursor_visible(true);
+                } else if (parameter_q && (esc_parameters[0]==1)) {
+                    // DECCKM: application cursor keys
+                    app_cursor = true;
+                } else if (parameter_q && ((esc_parameters[0]==1000) || (esc_parameters[0]==1002) ||
+                                           (esc_parameters[0]==1003) || (esc_parameters[0]==1006))) {
+                    // mouse tracking
+                    mouse_tracking(esc_parameters[0], true);
+                } else if (parameter_q && (esc_parameters[0]==2004)) {
+                    // bracketed paste
+                    paste_bracketed(true);
+                } else if (parameter_q && (esc_parameters[0]==3)) {
+                    // DECCOLM: 132 columns
+                    set_columns(true);
+                } else if (parameter_q && (esc_parameters[0]==8)) {
+                    // DECARM: keyboard auto repeat on
+                    keyb_autorepeat(true);
+                } else if (parameter_q && ((esc_parameters[0]==47) || (esc_parameters[0]==1047) ||
+                                           (esc_parameters[0]==1049))) {
+                    // alternate screen
+                    set_alt_screen(esc_parameters[0], true);
                 }
                 break;
             case 'l':
                 if (parameter_q && (esc_parameters[0]==25)) {
                     // hide csr
                     make_cursor_visible(false);
+                } else if (parameter_q && (esc_parameters[0]==1)) {
+                    // DECCKM: normal cursor keys
+                    app_cursor = false;
+                } else if (parameter_q && ((esc_parameters[0]==1000) || (esc_parameters[0]==1002) ||
+                                           (esc_parameters[0]==1003) || (esc_parameters[0]==1006))) {
+                    // mouse tracking off
+                    mouse_tracking(esc_parameters[0], false);
+                } else if (parameter_q && (esc_parameters[0]==2004)) {
+                    // bracketed paste off
+                    paste_bracketed(false);
+                } else if (parameter_q && (esc_parameters[0]==3)) {
+                    // DECCOLM: 80 columns
+                    set_columns(false);
+                } else if (parameter_q && (esc_parameters[0]==8)) {
+                    // DECARM: keyboard auto repeat off
+                    keyb_autorepeat(false);
+                } else if (parameter_q && ((esc_parameters[0]==47) || (esc_parameters[0]==1047) ||
+                                           (esc_parameters[0]==1049))) {
+                    // main screen
+                    set_alt_screen(esc_parameters[0], false);
                 }
                 break;
             case 'm':
                 //SGR
                 // Sets colors and style of the characters following this code
-                //TODO: implement color selection
-                n = esc_parameters[0];
-                if (n == 0) {
-                    // reset / normal
-                    // TODO: configure normal colors
-                    color_chr = COL_WHITE;
-                    color_bkg = COL_SEMIBLUE;
-                } else if (n == 7) {
-                    // reverse
-                    u8 aux = color_chr;
-                    color_chr = color_bkg;
-                    color_bkg = aux;
-                } else if ((n >= 30) && (n <= 37)) {
-                    // set foreground to ANSI color
-                    color_chr = ansi_pallet[n-30];
-                } else if ((n == 38) && (esc_parameters[1] == 5)) {
-                    // set foreground to rgb colot
-                    color_chr = esc_parameters[2] & 0xFF;
-                } else if ((n >= 40) && (n <= 47)) {
-                    // set background to ANSI color
-                    color_bkg = ansi_pallet[n-40];
-                } else if ((n == 48) && (esc_parameters[1] == 5)) {
-                    // set background to rgb colot
-                    color_bkg = esc_parameters[2] & 0xFF;
-                }
+                select_graphic_rendition();
                 break;
             case 'u':
             // move to saved cursor position
@@ -345,7 +557,7 @@ void init_sl() {
         // fill the fields
         update_sl_mode();
         write_sl(SL_BAUD, config_getbaud());
-        write_sl(SL_ID, ident);
+        update_sl_title();
         update_sl_lc();
     }
 }
@@ -353,15 +565,20 @@ void init_sl() {
 // update terminal mode in status line
 void update_sl_mode() {
     if (show_sl) {
+        if (macro_status() != NULL) {
+            // recording a macro
+            write_sl(SL_MODE, macro_status());
+            return;
+        }
         switch (term_mode) {
             case ONLINE:
-                write_sl(SL_MODE, "ONLINE");
+                write_sl(SL_MODE, "ONLINE ");
                 break;
             case LOCAL:
-                write_sl(SL_MODE, "LOCAL ");
+                write_sl(SL_MODE, "LOCAL  ");
                 break;
             case CONFIG:
-                write_sl(SL_MODE, "CONFIG");
+                write_sl(SL_MODE, "CONFIG ");
                 break;
         }
     }
@@ -370,12 +587,183 @@ void update_sl_mode() {
 // update cursor pos in status line
 static void update_sl_lc() {
     if (show_sl) {
-        char buf[10];
-        sprintf(buf, "L=%02d C=%02d", csr.y+1, csr.x+1);
+        char buf[16];
+        sprintf(buf, "L=%02d C=%-3d", csr.y+1, csr.x+1);
         write_sl(SL_LC, buf);
     }
 }
 
+// update window title (or ident) in status line
+// padded or cut to the space before L=XX C=XXX
+static void update_sl_title() {
+    if (show_sl) {
+        char buf[MAXTEXTW+1];
+        const char *title = (sl_title[0] != 0) ? sl_title : ident;
+        int width = SL_LC - SL_ID - 1;
+        int n = strlen(title);
+        for (int i = 0; i < width; i++) {
+            buf[i] = (i < n) ? title[i] : ' ';
+        }
+        buf[width] = 0;
+        write_sl(SL_ID, buf);
+    }
+}
+
+// Switch between 80 and 132 columns (DECCOLM)
+// Keeps the current font, screen is cleared
+static void set_columns(bool wide) {
+    VideoSetGeometry(geometry_columns(geometry, wide));
+    cls();
+    home();
+    init_sl();
+}
+
+// Switch between the main and the alternate screen
+//   47   just switches
+//   1047 clears the alternate screen when leaving it
+//   1049 saves the cursor and clears the alternate screen when entering it,
+//        restores the cursor when leaving
+// Each screen has its own saved cursor
+static void set_alt_screen(int mode, bool on) {
+    if (on == alt_screen()) {
+        return;
+    }
+    if (on && (mode == 1049)) {
+        saved_csr.x = csr.x;
+        saved_csr.y = csr.y;
+    }
+    if (!on && (mode != 47)) {
+        cls();
+    }
+    struct scrpos aux = saved_csr;
+    saved_csr = other_saved_csr;
+    other_saved_csr = aux;
+    select_screen(on);
+    if (on && (mode == 1049)) {
+        cls();
+    }
+    if (!on && (mode == 1049)) {
+        csr.x = saved_csr.x;
+        csr.y = saved_csr.y;
+        constrain_cursor_values();
+    }
+}
+
+// Extended color (38 and 48): 5;n or 2;r;g;b, separated by ';' or ':'
+// Returns the number of parameters used after the first one
+// The color is not changed if not supported
+static int sgr_ext_color(int i, int nparam, u8 *ansi, u8 *col) {
+    if ((i+1) >= nparam) {
+        return 0;
+    }
+    int mode = esc_parameters[i+1];
+    if (mode == 5) {
+        if ((i+2) < nparam) {
+            // 256 colors
+            int n = esc_parameters[i+2];
+            if (n < 16) {
+                *ansi = n;
+            } else if (n < 256) {
+                *ansi = SGR_DIRECT;
+                col[0] = col[1] = quant.xterm[n-16];
+            }
+        }
+        return 2;
+    } else if (mode == 2) {
+        // direct RGB color
+        // with ':' there may be a color space id before r:g:b
+        int used = 4;
+        if ((esc_subparam & (1 << (i+1))) && ((i+5) < nparam) && (esc_subparam & (1 << (i+5)))) {
+            used = 5;
+        }
+        if ((i+used) < nparam) {
+            int r = esc_parameters[i+used-2];
+            int g = esc_parameters[i+used-1];
+            int b = esc_parameters[i+used];
+            if ((r < 256) && (g < 256) && (b < 256)) {
+                *ansi = SGR_DIRECT;
+                for (int d = 0; d < 2; d++) {
+                    col[d] = PAL_DIRECT((quant.lev8[d][r] << 5) | (quant.lev8[d][g] << 2) | quant.lev4[d][b]);
+                }
+            }
+        }
+        return used;
+    }
+    return 1;
+}
+
+// Select Graphic Rendition (SGR)
+// Handles all the parameters, the attributes are kept in color_atr and the
+// colors used in the screen are recalculated at the end
+static void select_graphic_rendition() {
+    int nparam = esc_parameter_count + 1;
+    if (nparam > MAX_ESC_PARAMS) {
+        nparam = MAX_ESC_PARAMS;
+    }
+    for (int i = 0; i < nparam; i++) {
+        int n = esc_parameters[i];
+        if (n < 30) {
+            // attributes
+            color_atr = (color_atr & ~sgr_clr[n]) | sgr_set[n];
+            if (n == 0) {
+                sgr_fg = sgr_bg = SGR_DIRECT;
+                sgr_fg_col[0] = sgr_fg_col[1] = PAL_DEF_FG;
+                sgr_bg_col[0] = sgr_bg_col[1] = PAL_DEF_BG;
+            }
+        } else if (n < 38) {
+            // foreground ANSI color
+            sgr_fg = n - 30;
+        } else if (n == 38) {
+            i += sgr_ext_color(i, nparam, &sgr_fg, sgr_fg_col);
+        } else if (n == 39) {
+            // default foreground
+            sgr_fg = SGR_DIRECT;
+            sgr_fg_col[0] = sgr_fg_col[1] = PAL_DEF_FG;
+        } else if (n < 48) {
+            // background ANSI color
+            sgr_bg = n - 40;
+        } else if (n == 48) {
+            i += sgr_ext_color(i, nparam, &sgr_bg, sgr_bg_col);
+        } else if (n == 49) {
+            // default background
+            sgr_bg = SGR_DIRECT;
+            sgr_bg_col[0] = sgr_bg_col[1] = PAL_DEF_BG;
+        } else if ((n >= 90) && (n <= 97)) {
+            // bright foreground
+            sgr_fg = n - 90 + 8;
+        } else if ((n >= 100) && (n <= 107)) {
+            // bright background
+            sgr_bg = n - 100 + 8;
+        }
+        // skip sub-parameters not handled
+        while (((i+1) < nparam) && (esc_subparam & (1 << (i+1)))) {
+            i++;
+        }
+    }
+
+    // colors to use (even and odd cells), bold selects the bright version of the ANSI colors
+    u8 fg[2], bg[2];
+    for (int d = 0; d < 2; d++) {
+        fg[d] = sgr_fg_col[d];
+        if (sgr_fg != SGR_DIRECT) {
+            fg[d] = PAL_ANSI + (sgr_fg | ((color_atr & ATR_BOLD) << 3));
+        }
+        bg[d] = (sgr_bg == SGR_DIRECT) ? sgr_bg_col[d] : PAL_ANSI + sgr_bg;
+        if (color_atr & ATR_REVERSE) {
+            u8 aux = fg[d];
+            fg[d] = bg[d];
+            bg[d] = aux;
+        }
+        if (color_atr & ATR_HIDDEN) {
+            fg[d] = bg[d];
+        }
+    }
+    color_chr = fg[0];
+    color_bkg = bg[0];
+    color_chr_alt = fg[1];
+    color_bkg_alt = bg[1];
+}
+
 // Aux rotine to print a message
 static void print_string(char *str){
     for(int i=0; str[i] != '\0'; i++){
@@ -388,7 +776,8 @@ void collect_sequence(u8 chrx) {
     // waiting on parameter character, semicolon or final byte
     if((chrx >= '0') && (chrx <= '9')) { 
         // parameter value
-        if(esc_parameter_count < MAX_ESC_PARAMS) {
+        if((esc_parameter_count < MAX_ESC_PARAMS) &&
+           (esc_parameters[esc_parameter_count] <= MAX_ESC_VALUE)) {
             esc_parameters[esc_parameter_count] *= 10;
             esc_parameters[esc_parameter_count] += chrx - 0x30;
         }
@@ -399,6 +788,15 @@ void collect_sequence(u8 chrx) {
             esc_parameter_count++;
         }
     }
+    else if (chrx == ':') { 
+        // move to next param, marking it as a sub-parameter
+        if (esc_parameter_count < MAX_ESC_PARAMS) {
+            esc_parameter_count++;
+            if (esc_parameter_count < MAX_ESC_PARAMS) {
+                esc_subparam |= 1 << esc_parameter_count;
+            }
+        }
+    }
     else if (chrx == '?') { 
         parameter_q=true;
     }
@@ -412,28 +810,345 @@ void collect_sequence(u8 chrx) {
     }
 }
 
+// Put a glyph at the cursor and advance the cursor
+static void put_glyph(u8 ch) {
+    slip_character(ch);
+    if (csr.x < (COLUMNS-1)) {
+        csr.x++;
+    } else if (autowrap) {
+        csr.x=0;
+        advance_line();
+    }
+}
+
+// Invoke a character set in GL, for the next character only if single
+static void invoke_charset(int g, bool single) {
+    if (single) {
+        if (gset[g] != gl_map) {
+            gl_map = gset[g] ? gset[g] : charset_identity;
+            single_shift = true;
+        }
+    } else {
+        gl_set = g;
+        gl_map = gset[g];
+        single_shift = false;
+    }
+}
+
+// Decode a byte of a UTF-8 sequence (0x80 to 0xFF)
+// Invalid, overlong and truncated sequences show the replacement glyph
+static void utf8_decode(u8 chrx) {
+    if ((chrx & 0xC0) == 0x80) {
+        // continuation byte
+        if (utf8_need == 0) {
+            put_glyph(GLYPH_REPLACEMENT);
+            return;
+        }
+        utf8_cp = (utf8_cp << 6) | (chrx & 0x3F);
+        if (--utf8_need == 0) {
+            if ((utf8_cp < utf8_min) || (utf8_cp > 0x10FFFF) ||
+                ((utf8_cp >= 0xD800) && (utf8_cp < 0xE000))) {
+                put_glyph(GLYPH_REPLACEMENT);
+            } else if ((utf8_cp < 0x300) || (utf8_cp >= 0x370)) {
+                // combining diacritical marks (0x300 to 0x36F) are dropped
+                put_glyph(charset_glyph(utf8_cp));
+            }
+        }
+        return;
+    }
+    if (utf8_need) {
+        // previous sequence was truncated
+        put_glyph(GLYPH_REPLACEMENT);
+    }
+    if ((chrx & 0xE0) == 0xC0) {
+        utf8_need = 1;
+        utf8_cp = chrx & 0x1F;
+        utf8_min = 0x80;
+    } else if ((chrx & 0xF0) == 0xE0) {
+        utf8_need = 2;
+        utf8_cp = chrx & 0x0F;
+        utf8_min = 0x800;
+    } else if ((chrx & 0xF8) == 0xF0) {
+        utf8_need = 3;
+        utf8_cp = chrx & 0x07;
+        utf8_min = 0x10000;
+    } else {
+        utf8_need = 0;
+        put_glyph(GLYPH_REPLACEMENT);
+    }
+}
+
+// Start of a string sequence
+static void start_string(u8 type) {
+    str_cmd = -1;
+    str_discard = (type != ']');
+    str_len = 0;
+    str_index = -1;
+}
+
+// Convert a hex color component with 1 to 4 digits to 8 bits
+static int hex_component(const u8 *s, int ndig) {
+    int v = 0;
+    for (int i = 0; i < ndig; i++) {
+        u8 c = s[i];
+        if ((c >= '0') && (c <= '9')) {
+            v = (v << 4) + c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            v = (v << 4) + c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            v = (v << 4) + c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    // scale to 8 bits
+    switch (ndig) {
+        case 1: return v * 0x11;
+        case 2: return v;
+        case 3: return v >> 4;
+        default: return v >> 8;
+    }
+}
+
+// Parse a X11 color spec (rgb:r/g/b or #rgb) in str_buf
+// Returns the R3G3B2 color or -1 if not valid
+static int parse_color_spec(void) {
+    int rgb[3];
+    u8 *s = str_buf;
+    if ((str_len > 4) && (memcmp(s, "rgb:", 4) == 0)) {
+        s += 4;
+        for (int i = 0; i < 3; i++) {
+            int n = 0;
+            while ((s[n] != '/') && (s[n] != 0)) {
+                n++;
+            }
+            if ((n < 1) || (n > 4) || ((s[n] == 0) != (i == 2))) {
+                return -1;
+            }
+            rgb[i] = hex_component(s, n);
+            s += n+1;
+        }
+    } else if ((str_len > 1) && (s[0] == '#') && (((str_len-1) % 3) == 0) && (str_len <= 13)) {
+        int n = (str_len-1) / 3;
+        for (int i = 0; i < 3; i++) {
+            rgb[i] = hex_component(s+1+i*n, n);
+        }
+    } else {
+        return -1;
+    }
+    if ((rgb[0] < 0) || (rgb[1] < 0) || (rgb[2] < 0)) {
+        return -1;
+    }
+    return (QuantTables::level(rgb[0], 8, 2) << 5) | (QuantTables::level(rgb[1], 8, 2) << 2) |
+           QuantTables::level(rgb[2], 4, 2);
+}
+
+// Handle an item of OSC 4 (index and spec pairs), OSC 10 and 11 (specs)
+// or OSC 104 (indexes)
+// The colors are changed in the palette, the screen is not rewritten
+static void osc_palette_item(void) {
+    str_buf[str_len] = 0;
+    if (str_cmd == 104) {
+        int n = atoi((char *) str_buf);
+        if ((str_len > 0) && (n < 16)) {
+            palette_reset(PAL_ANSI + n);
+        }
+    } else if (str_index < 0) {
+        // OSC 4 color index, only the ANSI colors can be changed
+        int n = atoi((char *) str_buf);
+        str_index = (n < 16) ? PAL_ANSI + n : 0;
+    } else {
+        // color spec, queries ('?') are ignored
+        int color = parse_color_spec();
+        if ((color >= 0) && (str_index != 0)) {
+            palette_set(str_index, color);
+        }
+        if (str_cmd == 4) {
+            str_index = -1;
+        } else {
+            // OSC 10 may be followed by the background
+            str_index = (str_index == PAL_DEF_FG) ? PAL_DEF_BG : 0;
+        }
+    }
+    str_len = 0;
+}
+
+// Decode a character of the OSC 52 data (base64)
+static void osc_clipboard_char(u8 chrx) {
+    int v;
+    if (!clip_data) {
+        // skip the selection parameter
+        if (chrx == ';') {
+            clip_data = true;
+            clip_len = 0;
+            b64_bits = 0;
+        }
+        return;
+    }
+    if ((chrx >= 'A') && (chrx <= 'Z')) {
+        v = chrx - 'A';
+    } else if ((chrx >= 'a') && (chrx <= 'z')) {
+        v = chrx - 'a' + 26;
+    } else if ((chrx >= '0') && (chrx <= '9')) {
+        v = chrx - '0' + 52;
+    } else if (chrx == '+') {
+        v = 62;
+    } else if (chrx == '/') {
+        v = 63;
+    } else {
+        // padding, '?' (query) and invalid characters
+        return;
+    }
+    b64_acc = (b64_acc << 6) | v;
+    b64_bits += 6;
+    if (b64_bits >= 8) {
+        b64_bits -= 8;
+        if (clip_len < CLIP_SIZE) {
+            clipboard[clip_len++] = b64_acc >> b64_bits;
+        } else {
+            str_discard = true;
+        }
+    }
+}
+
+// Collect a character of a string sequence
+static void collect_string(u8 chrx) {
+    if (str_cmd < 0) {
+        // OSC command number
+        if ((chrx >= '0') && (chrx <= '9') && (str_len < 3)) {
+            str_buf[str_len++] = chrx;
+            return;
+        }
+        str_buf[str_len] = 0;
+        str_cmd = atoi((char *) str_buf);
+        str_len = 0;
+        if (chrx != ';') {
+            str_discard = true;
+        } else if (str_cmd == 52) {
+            clip_data = false;
+        } else if (str_cmd == 4) {
+            str_index = -1;
+        } else if ((str_cmd == 10) || (str_cmd == 11)) {
+            str_index = (str_cmd == 10) ? PAL_DEF_FG : PAL_DEF_BG;
+        } else if ((str_cmd != 0) && (str_cmd != 2) && (str_cmd != 104)) {
+            str_discard = true;
+        }
+        return;
+    }
+    if (str_cmd == 52) {
+        osc_clipboard_char(chrx);
+    } else if ((chrx == ';') && (str_cmd != 0) && (str_cmd != 2)) {
+        osc_palette_item();
+    } else if (str_len < STR_BUFSIZE) {
+        str_buf[str_len++] = chrx;
+    } else if (str_cmd != 0 && str_cmd != 2) {
+        // too long (titles are truncated)
+        str_discard = true;
+    }
+}
+
+// End of a string sequence, execute it
+static void end_string(void) {
+    if (str_cmd < 0) {
+        // OSC without parameters
+        // 104 restores the ANSI colors, 110 and 111 the default colors
+        str_buf[str_len] = 0;
+        str_cmd = atoi((char *) str_buf);
+        if (!str_discard) {
+            if (str_cmd == 104) {
+                for (int i = 0; i < 16; i++) {
+                    palette_reset(PAL_ANSI + i);
+                }
+            } else if (str_cmd == 110) {
+                palette_reset(PAL_DEF_FG);
+            } else if (str_cmd == 111) {
+                palette_reset(PAL_DEF_BG);
+            }
+        }
+    } else if (!str_discard) {
+        switch (str_cmd) {
+            case 0:
+            case 2:
+                // window title
+                {
+                    int n = 0;
+                    for (int i = 0; i < str_len; i++) {
+                        if (str_buf[i] >= 0x20) {
+                            sl_title[n++] = str_buf[i];
+                        }
+                    }
+                    sl_title[n] = 0;
+                    update_sl_title();
+                }
+                break;
+            case 4:
+            case 10:
+            case 11:
+            case 104:
+                if (str_len > 0) {
+                    osc_palette_item();
+                }
+                break;
+        }
+    }
+    esc_state = ESC_READY;
+}
+
 // Handle received char
 void terminal_handle_rx(u8 chrx) {
 
+    // string sequences are consumed without touching the screen
+    if (esc_state == ESC_STRING) {
+        if (chrx >= 0x20) {
+            if (!str_discard) {
+                collect_string(chrx);
+            }
+            return;
+        }
+        if (chrx == ESC) {
+            // ESC \ (ST) ends the string, the '\' is ignored as an escape sequence
+            end_string();
+            esc_state = ESC_ESC_RECEIVED;
+        } else if (chrx == BEL) {
+            end_string();
+        } else if ((chrx == CAN) || (chrx == SUB)) {
+            // abort
+            esc_state = ESC_READY;
+        }
+        return;
+    }
+
     clear_cursor();
 
     // handle escape sequences
     if (esc_state == ESC_READY) {
         if ((chrx >= 0x20) && (chrx < 0x7f)) {  
             // regular characters
-            slip_character(chrx);
-            // advance cursor
-            if (csr.x < (COLUMNS-1)) {
-                csr.x++;
-            } else if (autowrap) {
-                csr.x=0;
-                advance_line();
+            if (utf8_need) {
+                // truncated UTF-8 sequence
+                utf8_need = 0;
+                put_glyph(GLYPH_REPLACEMENT);
+            }
+            if (gl_map) {
+                // not ASCII
+                chrx = gl_map[chrx];
+                if (single_shift) {
+                    single_shift = false;
+                    gl_map = gset[gl_set];
+                }
             }
+            put_glyph(chrx);
+        }
+        else if (chrx >= 0x80) {
+            // UTF-8 sequence
+            utf8_decode(chrx);
         }
         else if (chrx == ESC) {
+            utf8_need = 0;
             esc_state=ESC_ESC_RECEIVED;
         }
         else {
+            utf8_need = 0;
             // control characters
             switch (chrx) {
                 case BEL:
@@ -468,13 +1183,19 @@ void terminal_handle_rx(u8 chrx) {
                     cls(); 
                     home();
                     break; 
+                case SO:
+                    invoke_charset(1, false);
+                    break;
+                case SI:
+                    invoke_charset(0, false);
+                    break;
             }
         }
      } else {
         switch(esc_state){
             case ESC_ESC_RECEIVED:
                 // waiting on c1 character
-                if ((chrx >= 'N') && (chrx < '_')) { 
+                if ((chrx >= 'N') && (chrx <= '_')) { 
                     // 0x9B = CSI, that's the only one we're interested in atm
                     // the others are 'Fe Escape sequences'
                     // usually two bytes, ie we have them already. 
@@ -484,12 +1205,37 @@ void terminal_handle_rx(u8 chrx) {
                         esc_state = ESC_PARAMETER_READY;
                         clear_escape_parameters();
                     }
+                    else if ((chrx==']') || (chrx=='P') || (chrx=='X') || (chrx=='^') || (chrx=='_')) {
+                        // OSC, DCS, SOS, PM and APC strings
+                        start_string(chrx);
+                        esc_state = ESC_STRING;
+                    }
+                    else if ((chrx=='N') || (chrx=='O')) {
+                        // single shift 2 or 3
+                        invoke_charset(chrx-'N'+2, true);
+                        reset_escape_sequence();
+                    }
                     // other type Fe sequences go here
                     else{
                         // for now, do nothing
                         reset_escape_sequence();
                     }
                 }
+                else if ((chrx >= '(') && (chrx <= '+')) {
+                    // designate G0 to G3, wait for the set
+                    esc_c1 = chrx;
+                    esc_state = ESC_CHARSET;
+                }
+                else if ((chrx=='n') || (chrx=='o')) {
+                    // locking shift 2 or 3
+                    invoke_charset(chrx-'n'+2, false);
+                    reset_escape_sequence();
+                }
+                else if ((chrx=='=') || (chrx=='>')) {
+                    // DECKPAM / DECKPNM: application or numeric keypad
+                    app_keypad = (chrx=='=');
+                    reset_escape_sequence();
+                }
                 else{
                     // unrecognised character after escape. 
                     reset_escape_sequence();
@@ -498,6 +1244,14 @@ void terminal_handle_rx(u8 chrx) {
             case ESC_PARAMETER_READY:
                 collect_sequence(chrx);
                 break; 
+            case ESC_CHARSET:
+                // designate a character set, unsupported sets are ASCII
+                gset[esc_c1-'('] = charset_designate(chrx);
+                if (!single_shift) {
+                    gl_map = gset[gl_set];
+                }
+                reset_escape_sequence();
+                break;
         }
     }
 
@@ -37,14 +37,32 @@
 #define LF          0x0a
 #define CR          0x0d 
 #define FF          0x0c
+#define SO          0x0e
+#define SI          0x0f
+#define CAN         0x18
+#define SUB         0x1a
+
+// Character attributes (SGR), packed in one byte
+// The low nibble is the part that is kept in the screen
+#define ATR_BOLD        0x01
+#define ATR_DIM         0x02
+#define ATR_UNDERLINE   0x04
+#define ATR_BLINK       0x08
+#define ATR_ITALIC      0x10
+#define ATR_REVERSE     0x20
+#define ATR_HIDDEN      0x40
+#define ATR_STRIKE      0x80
 
 extern u8 color_chr, color_bkg, color_sl_chr, color_sl_bkg;
+extern u8 color_chr_alt, color_bkg_alt;
+extern u8 color_atr;
 extern bool autowrap, bserases, cr_crlf, lf_crlf;
 
 extern void terminal_init(void);
 extern void terminal_handle_rx(u8 chrx);
-extern void send_key(uint8_t ch);
-extern void receive_key(uint8_t ch);
+extern int encode_key(KEY_EVENT ev, uint8_t *buf);
+extern void send_key(KEY_EVENT ev);
+extern void receive_key(KEY_EVENT ev);
 
 extern void cls(void);
 
@@ -76,11 +76,12 @@
 
 #define CFG_TUH_HUB                 1
 #define CFG_TUH_CDC                 0
-#define CFG_TUH_HID                 4  // typical keyboard + mouse device can have 3-4 HID interfaces
+#define CFG_TUH_HID                 8  // HID interfaces in all devices (a keyboard + mouse device can have 3-4)
 #define CFG_TUH_MSC                 0
 #define CFG_TUH_VENDOR              0
 
 #define CFG_TUSB_HOST_DEVICE_MAX    (CFG_TUH_HUB ? 5 : 1) // normal hub has 4 ports
+#define CFG_TUH_DEVICE_MAX          (CFG_TUH_HUB ? 4 : 1) // devices besides the hub
 
 //------------- HID -------------//
 
@@ -11,10 +11,13 @@
 #define STRIPMAX	8	// max. number of video strips (size of 1 sStrip = sSegm size*SEGMAX+4 = 228 bytes)
 				// size of sScreen = sStrip size*STRIPMAX+4 = 1828 bytes
 
-#define MAXX		640	// max. resolution in X direction (must be power of 4)
-#define MAXY		480	// max. resolution in Y direction
+#define MAXX		1056	// max. resolution in X direction (must be power of 4)
+#define MAXY		768	// max. resolution in Y direction
 
-#define MAXLINE		700	// max. number of scanlines (including sync and dark lines)
+#define MAXLINE		810	// max. number of scanlines (including sync and dark lines)
+
+#define RENDER_SCRATCH	1	// 1=hot render data in scratch X bank (private to core 1, shared with core 1 stack)
+				// 0=in striped main SRAM (to compare bus contention with BUSCTRL counters)
 
 // === Scanline render buffers (800 pixels: default size of buffers = 2*4*(800+8+800+24)+800 = 13856 bytes
 //    Requirements by format, base layer 0, 1 wrap X segment:
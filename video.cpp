@@ -32,11 +32,14 @@
 // Screen dimensions
 #define COLUMNS     TEXTW
 #define ROWS        TEXTH
-static int nlines = ROWS-1;
+int nlines;
 
 // The screen
-extern u8 TextBuf[TEXTSIZE];
-static u8 *linAddr[ROWS];
+// The main (TextBuf) and the alternate (AltBuf) screens have their own line
+// address table, switching screens just changes pointers
+u8 *ScrBuf = TextBuf;
+static u8 *lineTab[2][MAXTEXTH];
+static u8 **linAddr = lineTab[0];
 
 // screen control
 bool show_sl = true;
@@ -46,14 +49,69 @@ static unsigned char chr_under_csr = 0xFF;
 // Cursor
 struct scrpos csr = {0,0};
 
-// Video initialization
-void video_init() {
-    // Calcule starting address for the lines
+// Default colors of the palette slots (PAL_FIRST to PAL_LAST)
+static const u8 pal_default[PAL_LAST-PAL_FIRST+1] = {
+    COL_BLACK, COL_RED, COL_GREEN, COL_YELLOW, COL_BLUE, COL_MAGENTA, COL_CYAN, COL_WHITE,
+    CGACOL_8, CGACOL_12, CGACOL_10, CGACOL_14, CGACOL_9, CGACOL_13, CGACOL_11, CGACOL_15,
+    COL_WHITE, COL_SEMIBLUE,
+    COL_WHITE, COL_BLUE,
+    COL_WHITE, COL_SEMIGREEN
+};
+
+// Address of a line of the screen
+u8 *screen_line(int l) {
+    return linAddr[l];
+}
+
+// Attributes of a screen position
+static inline u8 *attr_addr(int l, int c) {
+    return ATTRBUF(ScrBuf) + l*COLUMNS + c;
+}
+
+// Calcule starting address for the lines
+static void set_line_addr() {
     u8 *p = TextBuf;
+    u8 *q = AltBuf;
     for (int i = 0; i < ROWS; i++) {
-        linAddr[i] =  p;
+        lineTab[0][i] =  p;
+        lineTab[1][i] =  q;
         p += TEXTWB;
+        q += TEXTWB;
+    }
+    nlines = show_sl? ROWS-1 : ROWS;
+}
+
+// Palette initialization
+void palette_init() {
+    for (int i = 0; i < 256; i++) {
+        palette_set(i, i);
+    }
+    for (int i = PAL_FIRST; i <= PAL_LAST; i++) {
+        palette_reset(i);
+    }
+}
+
+// Change a palette entry, the screen is updated in the next frame
+void palette_set(u8 idx, u8 color) {
+    XTextPalSet(idx, color);
+}
+
+// Restore the default color of a palette slot
+void palette_reset(u8 idx) {
+    if ((idx >= PAL_FIRST) && (idx <= PAL_LAST)) {
+        palette_set(idx, pal_default[idx-PAL_FIRST]);
     }
+}
+
+// Current color of a palette entry
+u8 palette_get(u8 idx) {
+    return XTextPal[idx] & 0xFF;
+}
+
+// Video initialization
+void video_init() {
+    palette_init();
+    set_line_addr();
 
     // Init screen
     cls();
@@ -61,6 +119,72 @@ void video_init() {
     init_sl();
 }
 
+// Fill a screen buffer with spaces, without attributes
+static void clear_buffer(u8 *p) {
+    for (int i = 0; i < TEXTSIZE; ) {
+        p[i++] = ' ';
+        p[i++] = color_bkg;
+        p[i++] = color_chr;
+    }
+    memset(ATTRBUF(p), 0, TEXTW*TEXTH);
+}
+
+// Adjust to a new text geometry
+// The screen not shown is cleared, its layout is no longer valid
+void video_resize() {
+    set_line_addr();
+    constrain_cursor_values();
+    clear_buffer((ScrBuf == TextBuf) ? AltBuf : TextBuf);
+}
+
+// Select the main or the alternate screen
+// Only the status line is copied to the new screen (without the status
+// line the last line belongs to the terminal)
+void select_screen(bool alt) {
+    u8 *buf = alt ? AltBuf : TextBuf;
+    if (buf == ScrBuf) {
+        return;
+    }
+    scrollback_live();      // the history window may be using AltBuf
+    if (show_sl) {
+        memcpy(buf + TEXTSIZE - TEXTWB, ScrBuf + TEXTSIZE - TEXTWB, TEXTWB);
+        memcpy(ATTRBUF(buf) + (ROWS-1)*COLUMNS, ATTRBUF(ScrBuf) + (ROWS-1)*COLUMNS, COLUMNS);
+    }
+    ScrBuf = buf;
+    linAddr = lineTab[alt ? 1 : 0];
+    VideoSetText(ScrBuf);
+}
+
+bool alt_screen() {
+    return ScrBuf == AltBuf;
+}
+
+// The alternate screen buffer is free while the main screen is shown and
+// can be lent (to the scrollback history window)
+// Returns NULL while the alternate screen is shown
+u8 *borrow_alt_screen() {
+    return (ScrBuf == AltBuf) ? NULL : AltBuf;
+}
+
+// Take back the alternate screen buffer, it is left cleared
+void return_alt_screen() {
+    clear_buffer(AltBuf);
+}
+
+// Mark or unmark a cell as selected
+// When the renderer doesn't draw the attributes (132 columns) the colors of
+// the cell are also swapped; writing the cell clears both
+void mark_selected(u8 *cell, u8 *atr, bool on) {
+    if (((*atr & ATR_SELECT) != 0) == on) {
+        return;
+    }
+    *atr ^= ATR_SELECT;
+    if (!VideoAttributes()) {
+        u8 bkg = cell[1];
+        cell[1] = cell[2];
+        cell[2] = bkg;
+    }
+}
 
 // Move cursor to home
 void home() {
@@ -88,10 +212,11 @@ void cls(u8 clr_bkg, u8 clr_chr) {
         end -= 3* COLUMNS;
     }
 	for (int i = 0; i < end; ) {
-		TextBuf[i++] = ' ';
-		TextBuf[i++] = clr_bkg;
-    	TextBuf[i++] = clr_chr;
+		ScrBuf[i++] = ' ';
+		ScrBuf[i++] = clr_bkg;
+    	ScrBuf[i++] = clr_chr;
 	}
+    memset(ATTRBUF(ScrBuf), 0, TEXTW*TEXTH);
 }
 
 // clear line from cursor to end of line
@@ -102,6 +227,7 @@ void clear_line_from_cursor() {
 		*p++ = color_bkg;
     	*p++ = color_chr;
     }
+    memset(attr_addr(csr.y, csr.x), 0, COLUMNS-csr.x);
 }
 
 // clear line from start of line to cursor
@@ -112,6 +238,7 @@ void clear_line_to_cursor() {
 		*p++ = color_bkg;
     	*p++ = color_chr;
     }
+    memset(attr_addr(csr.y, 0), 0, csr.x+1);
 }
 
 // clear line
@@ -122,6 +249,7 @@ void clear_entire_line() {
 		*p++ = color_bkg;
     	*p++ = color_chr;
     }
+    memset(attr_addr(csr.y, 0), 0, COLUMNS);
 }
 
 // clear screen from cursor to end of screen
@@ -135,6 +263,7 @@ void clear_screen_from_csr() {
             *p++ = color_bkg;
             *p++ = color_chr;
         }
+        memset(attr_addr(l, start), 0, COLUMNS-start);
         l++;
     }
 }
@@ -150,6 +279,7 @@ void clear_screen_to_csr() {
             *p++ = color_bkg;
             *p++ = color_chr;
         }
+        memset(attr_addr(l, 0), 0, end);
         l++;
     }
 }
@@ -177,11 +307,18 @@ void constrain_cursor_values() {
 }
 
 // Put char in the screen memory at cursor, taking in account the color
+// Odd cells (in a checkerboard pattern) use the alternate colors
 void slip_character(unsigned char ch) {
     u8 *p = linAddr[csr.y]+3*csr.x;
     *p++ = ch;
-    *p++ = color_bkg;
-    *p++ = color_chr;
+    if ((csr.x ^ csr.y) & 1) {
+        *p++ = color_bkg_alt;
+        *p++ = color_chr_alt;
+    } else {
+        *p++ = color_bkg;
+        *p++ = color_chr;
+    }
+    *attr_addr(csr.y, csr.x) = color_atr & 0x0F;
 }
 
 // Put char in screen memory, without changing color
@@ -199,13 +336,23 @@ static unsigned char get_character(int x,int y){
 // Scroll up screen n lines
 // TODO: change rendering to use linAddr and just move pointers
 void scroll_up(int n) {
+    // keep the lines in the history (not for the alternate screen)
+    if (ScrBuf == TextBuf) {
+        for (int i = 0; i < n; i++) {
+            scrollback_push(linAddr[i], COLUMNS);
+        }
+    }
+
     int size = n*3*COLUMNS;
-    memmove (TextBuf, TextBuf+size, TEXTSIZE-size);
+    memmove (ScrBuf, ScrBuf+size, TEXTSIZE-size);
     for (int i = TEXTSIZE - size; i < TEXTSIZE; ) {
-		TextBuf[i++] = ' ';
-		TextBuf[i++] = color_bkg;
-		TextBuf[i++] = color_chr;
+		ScrBuf[i++] = ' ';
+		ScrBuf[i++] = color_bkg;
+		ScrBuf[i++] = color_chr;
     }
+    u8 *atr = ATTRBUF(ScrBuf);
+    memmove(atr, atr + n*COLUMNS, (ROWS-n)*COLUMNS);
+    memset(atr + (ROWS-n)*COLUMNS, 0, n*COLUMNS);
 }
 
 // Show cursor (if visible)
@@ -292,8 +439,8 @@ void show_statusline (bool show) {
 
 void clear_sl() {
     for (int i = TEXTSIZE - 3*COLUMNS; i < TEXTSIZE; ) {
-        TextBuf[i++] = ' ';
-        TextBuf[i++] = color_sl_bkg;
-        TextBuf[i++] = color_sl_chr;
+        ScrBuf[i++] = ' ';
+        ScrBuf[i++] = color_sl_bkg;
+        ScrBuf[i++] = color_sl_chr;
     }
 }
\ No newline at end of file
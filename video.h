@@ -37,13 +37,57 @@ typedef struct scrpos {
 extern scrpos csr;
 
 // The screen
-extern u8 TextBuf[TEXTSIZE];
+extern u8 TextBuf[TEXTBUFSIZE];
+extern u8 AltBuf[TEXTBUFSIZE];
+extern u8 *ScrBuf;          // TextBuf or AltBuf
+
+// Number of lines available to the terminal
+extern int nlines;
+
+// Selected cell, in the attribute plane only (the renderer swaps the
+// colors), the character attributes use the low nibble
+#define ATR_SELECT      0x10
+extern void mark_selected(u8 *cell, u8 *atr, bool on);
+
+// Address of a line of the screen
+extern u8 *screen_line(int l);
+
+// Palette
+// The colors in the screen are indexes to the video palette (XTextPal), so
+// they can be redefined without rewriting the screen. Most indexes are
+// R3G3B2 colors that map to themselves, PAL_FIRST to PAL_LAST are slots
+// for the colors that can be changed
+#define PAL_ANSI        0x20    // 16 ANSI colors (normal and bright)
+#define PAL_DEF_FG      0x30    // default foreground
+#define PAL_DEF_BG      0x31    // default background
+#define PAL_SL_FG       0x32    // status line
+#define PAL_SL_BG       0x33
+#define PAL_CFG_FG      0x34    // config screen
+#define PAL_CFG_BG      0x35
+#define PAL_FIRST       PAL_ANSI
+#define PAL_LAST        PAL_CFG_BG
+
+// Index for a R3G3B2 color, the colors used by the slots are replaced
+// by the nearest ones without red
+#define PAL_DIRECT(c)   ((((c) >= PAL_FIRST) && ((c) <= PAL_LAST)) ? ((c) & 0x1F) : (c))
+
+extern void palette_init(void);
+extern void palette_set(u8 idx, u8 color);
+extern void palette_reset(u8 idx);
+extern u8 palette_get(u8 idx);
 
 // Status line control
 extern bool show_sl;
 
 // Initialization
 extern void video_init(void);
+extern void video_resize(void);
+
+// Main and alternate screen
+extern void select_screen(bool alt);
+extern bool alt_screen(void);
+extern u8 *borrow_alt_screen(void);
+extern void return_alt_screen(void);
 
 // Cursor control
 extern void home(void);